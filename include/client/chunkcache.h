@@ -0,0 +1,49 @@
+#ifndef CHUNKCACHE_H
+#define CHUNKCACHE_H
+
+#include "common.h"
+#include <map>
+
+struct ChunkManager;
+struct Chunk;
+
+// Copies of downloaded chunks, kept on disk between sessions in one file per world.
+// On join the client tells the server the hashes of what it has, and the
+//	server only sends the contents of chunks that don't match
+struct ChunkCache {
+	static constexpr f32 SaveInterval = 10.f; // Seconds
+
+	struct Entry {
+		u8 width, height, depth;
+		u64 hash; // Chunk::GetBlocksHash at the time it was stored
+		std::vector<u16> blocks; // Packed as blockID<<2 | orientation
+	};
+
+	std::map<u16, Entry> entries; // Keyed by chunkID
+	std::map<u16, u32> storedVersions; // Chunk::blocksVersion when each entry was stored
+	u64 worldID;
+	bool hasWorld;
+	bool dirty; // entries differ from what's on disk
+	f32 saveTimer;
+
+	static std::shared_ptr<ChunkCache> Get();
+
+	ChunkCache();
+
+	// Loads the cache for a world, saving the current one first
+	void SetWorld(u64 worldID);
+
+	// Fills a chunk from its cached copy. Returns false if there isn't a usable one
+	bool Restore(std::shared_ptr<Chunk>);
+	void Store(std::shared_ptr<Chunk>);
+
+	// Periodically stores chunks that have changed and writes them to disk
+	void Update(f32 dt, std::shared_ptr<ChunkManager>);
+	void Flush(std::shared_ptr<ChunkManager>);
+
+	bool Load();
+	void Save();
+	std::string GetFilename() const;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef CHUNKMESHARENA_H
+#define CHUNKMESHARENA_H
+
+#include "common.h"
+
+// Owns one vertex buffer and one face buffer shared by every chunk mesh.
+// Space is handed out in pages of PageSize quads so that a quad's face index
+//	(gl_VertexID>>2) can be mapped back to the mesh that owns it through
+//	the page table, which is how the voxel shader finds its model matrix
+struct ChunkMeshArena {
+	static constexpr u32 PageSize = 64; // Quads
+	static constexpr u32 InitialPageCount = 1024; // 1MB of vertex data
+
+	struct Allocation {
+		u32 firstPage;
+		u32 numPages;
+
+		Allocation(u32 f = 0, u32 n = 0) : firstPage{f}, numPages{n} {}
+
+		u32 FirstQuad() const { return firstPage*PageSize; }
+		bool IsValid() const { return numPages > 0; }
+	};
+
+	// Free page ranges, sorted by firstPage and never adjacent
+	std::vector<Allocation> freeList;
+	std::vector<u16> pageTable;
+	u32 pageCount;
+
+	u32 vertexBO, faceBO, faceTex;
+	u32 pageTableBO, pageTableTex;
+	bool pageTableDirty;
+
+	ChunkMeshArena();
+	~ChunkMeshArena();
+
+	// meshSlot is written into the page table for every page allocated
+	Allocation Allocate(u32 numQuads, u16 meshSlot);
+	void Free(Allocation);
+
+	// Copies mesh data into an allocation made with at least numQuads
+	void Upload(const Allocation&, u32 numQuads, const u8* vertexData, const u8* faceData);
+
+	// Flushes page table changes to the gpu
+	void Update();
+
+	// Reallocates both buffers, preserving contents
+	void Grow(u32 minPages);
+};
+
+#endif
\ No newline at end of file
@@ -2,32 +2,69 @@
 #define CHUNKRENDERER_H
 
 #include "common.h"
+#include "contentcache.h"
+#include "chunkmesharena.h"
+#include "chunkmeshbuilder.h"
+#include "chunkvisibility.h"
 
 struct Chunk;
 struct ChunkManager;
 
-struct ChunkRenderInfo {
-	u32 vertexBO, faceBO, faceTex;
+// A mesh in the arena. Shared by every chunk with the same 
+//	Chunk::contentHash and Chunk::lightHash at the same lod
+struct ChunkMesh {
+	ChunkMeshArena::Allocation allocation;
 	u32 numQuads;
+	u16 meshSlot;
 
-	ChunkRenderInfo();
-	ChunkRenderInfo(ChunkRenderInfo&&);
-	ChunkRenderInfo(const ChunkRenderInfo&) = delete;
-	~ChunkRenderInfo();
+	// Model matrices of every chunk drawing this mesh this frame
+	std::vector<mat4> instances;
+};
+
+struct ChunkRenderInfo {
+	// Meshes are fetched lazily the first time a lod is selected and
+	//	are dropped when Chunk::voxelVersion changes
+	std::shared_ptr<ChunkMesh> lods[ChunkMeshBuilder::LodCount];
+	std::weak_ptr<Chunk> chunk;
+	u32 voxelVersion;
+	u8 currentLod;
 
-	// Calls Chunk::BuildMesh()
-	void Update(std::shared_ptr<Chunk>);
+	ChunkRenderInfo();
 };
 
 struct ChunkRenderer {
 	std::map<u32, ChunkRenderInfo> chunkRenderInfoMap;
 	std::vector<u8> voxelTextures;
 
+	// All chunk meshes live in the arena. Meshes with a single visible user
+	//	are drawn together with one glMultiDrawElementsBaseVertex, shared meshes 
+	//	are drawn instanced. The voxel shader finds its model matrix through 
+	//	page -> mesh slot -> first instance
+	std::unique_ptr<ChunkMeshArena> arena;
+	ContentCache<ChunkMesh> meshCache;
+	std::vector<u16> freeMeshSlots;
+	u32 meshSlotCount;
+
+	u32 modelBO, modelTex;
+	u32 instanceBaseBO, instanceBaseTex;
+
+	// Rebuilt every frame
+	ChunkVisibility visibility;
+	std::vector<ChunkMesh*> frameMeshes;
+	std::vector<mat4> instanceMatrices;
+	std::vector<u32> instanceBases; // Indexed by mesh slot
+	std::vector<s32> drawCounts;
+	std::vector<s32> drawBaseVertices;
+
 	u32 textureArray;
 
 	ChunkRenderer();
 	~ChunkRenderer();
 	void Render();
+
+	// Finds or builds the mesh for a chunk at a given lod
+	// Calls ChunkMeshBuilder::BuildMesh() and uploads the result into the arena
+	std::shared_ptr<ChunkMesh> GetMesh(Chunk*, u8 lod);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef CHUNKVISIBILITY_H
+#define CHUNKVISIBILITY_H
+
+#include "common.h"
+#include <unordered_set>
+#include <unordered_map>
+
+struct ChunkNeighborhood;
+struct Chunk;
+
+// Cave culling
+// Walks each neighborhood outward from the camera, only passing through a
+//	chunk between faces that are joined by open space (Chunk::faceConnectivity)
+//	and never turning back towards the camera. Anything not reached is hidden
+//	behind solid chunks
+struct ChunkVisibility {
+	std::unordered_set<const Chunk*> visibleChunks;
+	std::unordered_map<u64, Chunk*> grid; // Scratch, positionInNeighborhood -> chunk
+
+	void Update(vec3 cameraPosition);
+	bool IsVisible(const Chunk*);
+
+	void UpdateNeighborhood(ChunkNeighborhood*, vec3 cameraPosition);
+};
+
+#endif
\ No newline at end of file
@@ -8,6 +8,7 @@
 struct OverlayManager;
 struct PlayerManager;
 struct ChunkManager;
+struct ChunkCache;
 struct LocalPlayer;
 struct Network;
 struct Camera;
@@ -24,6 +25,7 @@ struct Client {
 	std::shared_ptr<Network> network;
 	std::shared_ptr<LocalPlayer> player;
 	std::shared_ptr<ChunkManager> chunkManager;
+	std::shared_ptr<ChunkCache> chunkCache;
 	std::shared_ptr<PlayerManager> playerManager;
 	std::shared_ptr<OverlayManager> overlayManager;
 	std::shared_ptr<GUI> gui;
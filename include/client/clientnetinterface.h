@@ -4,6 +4,7 @@
 #include "common.h"
 
 struct Network;
+struct RegionEdit;
 
 struct ClientNetInterface {
 	static void Update(std::shared_ptr<Network>);
@@ -14,6 +15,7 @@ struct ClientNetInterface {
 	static void SetPlayerSector(u8);
 	static void SetBlock(u16 chunkID, ivec3 pos, u16 type, u8 orientation);
 	static void DoInteract(u16 chunkID, ivec3 pos);
+	static void EditRegion(u16 chunkID, const RegionEdit&);
 
 	static void RequestRefreshChunks();
 };
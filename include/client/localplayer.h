@@ -6,6 +6,7 @@
 #include "playerbase.h"
 
 struct Camera;
+struct Chunk;
 
 // TODO: Focus/interaction states
 // TODO: Fill in base methods
@@ -21,10 +22,20 @@ struct LocalPlayer : PlayerBase {
 
 	bool noclip;
 
+	// Corners of the box region edits apply to, inclusive
+	struct RegionCorner {
+		std::weak_ptr<Chunk> chunk;
+		ivec3 position;
+	};
+
+	RegionCorner regionCorners[2];
+	u8 regionCornerCount {0};
+
 	LocalPlayer(std::shared_ptr<Camera>);
 	~LocalPlayer();
 
 	void Update() override;
+	void UpdateRegionTool();
 
 	bool IsNoclip() override { return noclip; }
 	void SetNoclip(bool) override;
@@ -5,31 +5,56 @@
 #include "physics.h"
 #include "playerbase.h"
 
+// Remote players are rendered interpolationDelay behind the newest
+//	snapshot received, interpolating between buffered snapshots. 
+//	If snapshots stop arriving, motion is extrapolated for a short while
 struct NetPlayer : PlayerBase {
+	static constexpr u32 SnapshotCount = 32;
+	static constexpr f32 MaxExtrapolation = 0.25f; // Seconds
+
+	static f32 interpolationDelay; // Seconds
+
+	struct Snapshot {
+		u32 tick;
+		vec3 position;
+		vec3 velocity;
+		quat orientation;
+		quat eyeOrientation;
+	};
+
+	// Ring buffer ordered by tick, newest at snapshots[(firstSnapshot+numSnapshots-1) % SnapshotCount]
+	Snapshot snapshots[SnapshotCount];
+	u32 firstSnapshot;
+	u32 numSnapshots;
+
+	// Server tick being rendered, and the estimate of the server's
+	//	current tick it chases
+	f64 renderTick;
+	f64 serverTick;
+
 	quat orientation;
 	quat eyeOrientation;
-	quat realOri;
-	quat realEyeOri;
 
-	vec3 realPosition;
 	vec3 position;
 	vec3 velocity;
 	u8 sector;
 
-	f32 timeSinceUpdate;
-
 	NetPlayer();
 
 	void Update() override;
 	void Render() override;
 
-	void SetPosition(vec3) override;
-	void SetVelocity(vec3) override;
-	void SetOrientation(quat) override;
-	void SetEyeOrientation(quat) override;
+	void PushState(u32 tick, vec3, vec3, quat, quat) override;
+
+	vec3 GetPosition() override { return position; }
+	vec3 GetVelocity() override { return velocity; }
+	quat GetOrientation() override { return orientation; }
 
 	vec3 GetEyePosition() override;
 	quat GetEyeOrientation() override;
+
+	Snapshot& GetSnapshot(u32 i) { return snapshots[(firstSnapshot + i) % SnapshotCount]; }
+	void Sample(f64 tick);
 };
 
 
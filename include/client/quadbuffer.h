@@ -11,6 +11,11 @@ struct QuadElementBuffer {
 
 	static void SetNumQuads(u64);
 	static void Draw(u64);
+
+	// Draws drawCount ranges of the currently bound vertex buffer
+	// counts are in elements (6 per quad), baseVertices are in vertices (4 per quad)
+	static void MultiDraw(u64 maxQuads, const s32* counts, const s32* baseVertices, u32 drawCount);
+	static void DrawInstanced(u64 numQuads, s32 baseVertex, u32 instanceCount);
 };
 
 
@@ -0,0 +1,45 @@
+#ifndef CHUNKSTREAM_H
+#define CHUNKSTREAM_H
+
+#include "common.h"
+
+#include <set>
+#include <map>
+
+struct ChunkManager;
+
+// Queue of chunks waiting to be sent to one client.
+// Chunks are sent nearest first, and each tick only BytesPerTick worth
+//	is sent, so a join doesn't saturate the server's uplink.
+// Pending chunks are sorted again once the player has moved far enough
+struct ChunkStream {
+	static constexpr s32 BytesPerTick = 16*1024; // 320KB/s at 20 ticks/s
+	static constexpr f32 ReprioritizeDistance = 8.f;
+
+	std::vector<u16> pending; // Nearest last
+	std::set<u16> sentChunks; // Chunks the client knows about
+	std::set<u16> knownNeighborhoods; // Neighborhoods the client has a transform for
+
+	// Blocks hashes of the client's cached chunks. Nothing is sent
+	//	until the client has said what it has
+	std::map<u16, u64> clientHashes;
+	bool hashesReceived;
+
+	vec3 focus; // Position pending was last sorted around
+	s32 byteCredit;
+	bool needsSort;
+
+	ChunkStream();
+
+	// Chunks that have already been sent only get their contents sent again
+	void Queue(u16 chunkID);
+	void QueueAll(ChunkManager*);
+
+	// Sorts pending by distance to position if needed
+	void UpdateFocus(vec3 position, ChunkManager*);
+
+	bool HasPending() const;
+	u16 PopNearest();
+};
+
+#endif
\ No newline at end of file
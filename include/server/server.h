@@ -4,10 +4,14 @@
 #include "common.h"
 #include "network.h"
 #include "serverplayer.h"
+#include "session.h"
+#include "regionedit.h"
 
 #include <map>
 
 struct ChunkNeighborhood;
+struct BlockScheduler;
+struct ServerPhysics;
 struct PlayerManager;
 struct ChunkManager;
 struct Chunk;
@@ -15,27 +19,101 @@ struct Chunk;
 struct Server {
 	std::shared_ptr<PlayerManager> playerManager;
 	std::shared_ptr<ChunkManager> chunkManager;
+	std::shared_ptr<BlockScheduler> blockScheduler;
+	std::shared_ptr<ServerPhysics> physics;
 	std::shared_ptr<Network> network;
-	std::map<NetworkGUID, u16> guidToPlayerID;
+	SessionTable sessions;
 	u16 playerIDCount;
 	u16 chunkIDCount;
 	u16 neighborhoodIDCount;
+	u32 tick;
+	u64 worldID; // Random per run, since worlds aren't saved
+
+	// Remote players interpolate between snapshots, so state
+	//	doesn't need sending every tick
+	static constexpr u32 PlayerStateInterval = 2; // Ticks
+
+	// What clients were last told about a neighborhood, for dead reckoning
+	struct NeighborhoodState {
+		vec3 position;
+		quat rotation;
+		vec3 velocity;
+		vec3 angularVelocity;
+		vec3 pivot;
+		u32 tick;
+	};
+
+	std::map<u16, NeighborhoodState> sentNeighborhoodStates;
+
+	// Encoded ChunkDownload packets, shared between recipients until the chunk changes.
+	// Entries are erased by DestroyChunk, and the handle catches a chunk
+	//	that was dropped some other way and had its ID reused
+	struct EncodedChunk {
+		Handle<Chunk> chunk;
+		u32 blocksVersion;
+		u32 numBytes;
+		std::vector<Packet> packets;
+	};
+
+	std::map<u16, EncodedChunk> encodedChunks;
+
+	// Named templates for pasting, filled by admin scripts or Copy
+	std::map<u16, BlockTemplate> templates;
+
+	// Larger edits are rejected
+	static constexpr u64 MaxRegionVolume = 64*64*64;
+
+	// How far a client's prediction can drift before it's corrected
+	static constexpr f32 NeighborhoodPositionTolerance = 0.05f;
+	static constexpr f32 NeighborhoodAngleTolerance = 0.005f; // Radians
 
 	void Run();
 
 	void OnPlayerConnect(NetworkGUID);
 	void OnPlayerDisonnect(NetworkGUID);
 	void OnPlayerLostConnection(NetworkGUID);
-	void OnPlayerStateUpdate(Packet&);
-	void OnSetBlock(Packet&);
-	void OnInteract(Packet&);
+	void OnPlayerStateUpdate(Session&, Packet&);
+	void OnSetBlock(Session&, Packet&);
+	void OnInteract(Session&, Packet&);
+	void OnChunkDownloadRequest(Session&, Packet&);
+	void OnRegionEdit(Session&, Packet&);
+
+	// Sends to one session and counts it against its stats
+	void Send(Session&, const Packet&);
+	// Broadcasts if guid is Unassigned, otherwise goes through the session
+	void Send(const Packet&, NetworkGUID);
+
+	// Applies an edit to every chunk of origin's neighborhood that it overlaps
+	//	and replicates the result. The region is in origin's voxel space.
+	// playerID is 0 for edits that don't come from a player, which
+	//	can only copy to and paste from named templates
+	bool EditRegion(Chunk* origin, RegionEdit, u16 playerID = 0);
 
 	// If guid is Unassigned, these broadcast
-	void SendNewChunk(std::shared_ptr<Chunk>, NetworkGUID = RakNet::UNASSIGNED_RAKNET_GUID);
-	void SendChunkContents(std::shared_ptr<Chunk>, NetworkGUID = RakNet::UNASSIGNED_RAKNET_GUID);
-	void SendSetNeighborhood(std::shared_ptr<Chunk>, NetworkGUID = RakNet::UNASSIGNED_RAKNET_GUID);
+	// Those that return a size return the number of bytes sent
+	// If cached is set the client is told its cached copy is current
+	u32 SendNewChunk(Chunk*, NetworkGUID = RakNet::UNASSIGNED_RAKNET_GUID, bool cached = false);
+	// Empty chunks are skipped unless sendEmpty is set
+	u32 SendChunkContents(Chunk*, NetworkGUID = RakNet::UNASSIGNED_RAKNET_GUID, bool sendEmpty = false);
+	void SendSetNeighborhood(Chunk*, NetworkGUID = RakNet::UNASSIGNED_RAKNET_GUID);
+	EncodedChunk& GetEncodedChunk(Chunk*);
+
+	u32 SendNeighborhoodTransform(std::shared_ptr<ChunkNeighborhood>, NetworkGUID = RakNet::UNASSIGNED_RAKNET_GUID);
+
+	// Transform physics last published for a neighborhood, extrapolated from
+	//	the tick it was published for to the current one
+	void GetReplicatedTransform(ChunkNeighborhood*, vec3& position, quat& rotation);
+
+	// Sends queued chunks to each player within their byte budget
+	void UpdateChunkStreams();
+	void QueueChunkForAll(Chunk*);
+
+	// Drops a chunk along with everything the server has cached for it
+	//	and tells clients to remove it
+	void DestroyChunk(Chunk*);
 
-	void SendNeighborhoodTransform(std::shared_ptr<ChunkNeighborhood>, NetworkGUID = RakNet::UNASSIGNED_RAKNET_GUID);
+	// Broadcasts corrections for neighborhoods clients have mispredicted
+	void UpdateNeighborhoodReplication();
 };
 
 
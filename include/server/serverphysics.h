@@ -0,0 +1,65 @@
+#ifndef SERVERPHYSICS_H
+#define SERVERPHYSICS_H
+
+#include "common.h"
+
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <mutex>
+
+// Steps the server's physics on its own thread at a fixed rate.
+// Physics spaces are independent worlds with their own compound shapes and
+//	collision configurations, so they're stepped in parallel across a pool
+//	of workers. After each step the transform of every neighborhood is
+//	published to a double buffer for replication.
+// worldMutex is held for the whole step. The main thread must hold it
+//	while touching anything physics owns: chunks, neighborhoods and their bodies
+struct ServerPhysics {
+	static constexpr f32 TimeStep = 1.f/60.f;
+
+	struct NeighborhoodTransform {
+		u16 neighborhoodID;
+		vec3 position;
+		quat rotation;
+		u32 tick; // Server tick the transform is from
+	};
+
+	std::mutex worldMutex;
+	u32 worldTick; // Tick the main thread last moved bodies to. Guarded by worldMutex
+
+	// Only the physics thread writes the back buffer, so publishMutex
+	//	is only held to swap and to read the front buffer
+	std::mutex publishMutex;
+	std::vector<NeighborhoodTransform> transformBuffers[2];
+	u8 frontBuffer;
+
+	std::thread thread;
+	std::vector<std::thread> workers;
+	std::atomic<bool> running;
+
+	// Work distribution for a single step
+	std::mutex stepMutex;
+	std::condition_variable stepBegin;
+	std::condition_variable stepEnd;
+	u64 stepGeneration;
+	u32 workersDone;
+	std::atomic<u32> nextSpace;
+
+	ServerPhysics();
+	~ServerPhysics();
+
+	void Start(u32 workerCount);
+	void Stop();
+
+	// Returns false if the neighborhood hasn't been published yet.
+	//	Published transforms lag the main thread, so tick says which they're from
+	bool GetTransform(u16 neighborhoodID, vec3& position, quat& rotation, u32& tick);
+
+	void Run();
+	void WorkerRun();
+	void StepSpaces();
+	void Publish();
+};
+
+#endif
\ No newline at end of file
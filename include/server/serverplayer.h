@@ -3,6 +3,7 @@
 
 #include "common.h"
 #include "playerbase.h"
+#include "regionedit.h"
 
 struct ServerPlayer : PlayerBase {
 	NetworkGUID guid;
@@ -12,6 +13,8 @@ struct ServerPlayer : PlayerBase {
 	vec3 velocity;
 	u8 sector;
 
+	BlockTemplate clipboard; // Target of RegionOp::Copy with templateID 0
+
 	void SetPosition(vec3) override;
 	void SetVelocity(vec3) override;
 	void SetOrientation(quat) override;
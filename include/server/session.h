@@ -0,0 +1,73 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "common.h"
+#include "network.h"
+#include "chunkstream.h"
+#include "handleregistry.h"
+
+#include <unordered_map>
+
+struct ServerPlayer;
+
+// Everything the server keeps about one connection.
+// Lives from ID_NEW_INCOMING_CONNECTION until disconnect or lost connection,
+//	so packet handlers can take it instead of looking the player up
+struct Session {
+	// Block edits are limited by a token bucket. A SetBlock costs one
+	//	token, a region edit RegionEditCost
+	static constexpr f32 EditsPerSecond = 20.f;
+	static constexpr f32 EditBurst = 40.f;
+	static constexpr f32 RegionEditCost = 8.f;
+
+	struct Stats {
+		u64 bytesReceived;
+		u64 packetsReceived;
+		u64 bytesSent; // Only what's sent to this session directly, not broadcasts
+		u64 packetsSent;
+		u32 editsRejected;
+	};
+
+	NetworkGUID guid;
+	u16 playerID;
+	std::shared_ptr<ServerPlayer> player;
+
+	ChunkStream chunkStream;
+	Stats stats;
+
+	u32 connectTick;
+	u32 lastReceiveTick;
+	u32 lastStateTick; // Tick the last player state update arrived on
+	u16 lastAckedEdit; // Sequence of the last SetBlock acked
+	f32 editCredit;
+
+	Session();
+
+	void Receive(const Packet&, u32 tick);
+	void Sent(const Packet&);
+
+	// Refills the edit bucket
+	void Update(f32 dt);
+	// Returns false and counts a rejection if there isn't enough credit
+	bool TakeEditCredit(f32 cost);
+};
+
+// Sessions in one dense array, found by guid through a hash map.
+// Unlike indexing a std::map, looking up an unknown guid doesn't add it
+struct SessionTable {
+	HandleRegistry<Session> sessions;
+	std::unordered_map<u64, Handle<Session>> guidToSession; // Keyed by RakNetGUID::g
+
+	// Returns the existing session if guid already has one
+	Session* Open(NetworkGUID);
+	void Close(NetworkGUID);
+
+	Session* Find(NetworkGUID) const;
+
+	size_t size() const { return sessions.size(); }
+
+	std::vector<std::shared_ptr<Session>>::iterator begin() { return sessions.begin(); }
+	std::vector<std::shared_ptr<Session>>::iterator end() { return sessions.end(); }
+};
+
+#endif
\ No newline at end of file
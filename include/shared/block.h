@@ -2,6 +2,7 @@
 #define BLOCK_H
 
 #include "common.h"
+#include "blockpool.h"
 #include <array>
 
 enum class GeometryType {
@@ -34,8 +35,16 @@ struct DynamicBlock {
 	Block* block;
 	Chunk* chunk;
 	u8 x,y,z;
+
+	// Scheduling state, managed by BlockScheduler
+	static constexpr u32 NotAwake = ~0u;
+	u32 awakeIndex = NotAwake;
+	u64 wakeTick = 0; // Zero if no wakeup is pending
 	
-	virtual ~DynamicBlock() {};
+	virtual ~DynamicBlock();
+
+	// Called every tick while awake. See BlockScheduler
+	virtual void Update() {}
 
 	virtual void OnPlace(u16 /*playerID*/) {}
 	virtual void OnBreak(u16 /*playerID*/) {}
@@ -56,12 +65,16 @@ struct BlockFactory {
 	virtual ~BlockFactory() {}
 };
 
+// Instances are allocated from a per-type pool rather than the heap,
+//	so all blocks of a type can be walked with pool.ForEach
 template<class T>
 struct DynamicBlockFactory : BlockFactory {
+	BlockPool<T> pool;
+
 	void Create(Block* bl) override {
 		if(!bl) return;
 
-		auto dyn = new T;
+		auto dyn = pool.Allocate();
 		dyn->block = bl;
 
 		bl->blockID = blockID;
@@ -71,7 +84,7 @@ struct DynamicBlockFactory : BlockFactory {
 
 	void Destroy(Block* bl) override {
 		if(!bl) return;
-		delete static_cast<T*>(bl->dynamic);
+		pool.Free(static_cast<T*>(bl->dynamic));
 		bl->dynamic = nullptr;
 		bl->blockID = 0;
 	}
@@ -87,6 +100,7 @@ struct BlockInfo {
 	
 	std::array<u8, 6> textures;
 	bool doesOcclude;
+	u8 lightEmission; // Block light level, see BlockLightEngine
 
 	// Even with separate IDs, these blocks still need to have their textures
 	//	rotated
@@ -100,12 +114,12 @@ struct BlockRegistry {
 	u16 blockInfoCount = 0;
 
 	static BlockRegistry* Get();
-	static void RegisterWithFactory(std::string, GeometryType, std::array<u8, 6>, bool, BlockFactory*);
+	static void RegisterWithFactory(std::string, GeometryType, std::array<u8, 6>, bool, u8, BlockFactory*);
 
 	// Use these to register new block types, preferably in InitBlockInfo
 	template<class T>
-	static void Register(std::string, GeometryType, std::array<u8, 6>, bool);
-	static void Register(std::string, GeometryType, std::array<u8, 6>, bool);
+	static void Register(std::string, GeometryType, std::array<u8, 6>, bool, u8 lightEmission = 0);
+	static void Register(std::string, GeometryType, std::array<u8, 6>, bool, u8 lightEmission = 0);
 	
 	static void InitBlockInfo();
 	static BlockInfo* GetBlockInfo(u16 blockID);
@@ -116,8 +130,8 @@ struct BlockRegistry {
 };
 
 template<class T>
-void BlockRegistry::Register(std::string n, GeometryType g, std::array<u8, 6> t, bool o) {
-	RegisterWithFactory(n,g,t,o, new DynamicBlockFactory<T>);
+void BlockRegistry::Register(std::string n, GeometryType g, std::array<u8, 6> t, bool o, u8 l) {
+	RegisterWithFactory(n,g,t,o,l, new DynamicBlockFactory<T>);
 }
 
 #endif
@@ -0,0 +1,112 @@
+#ifndef BLOCKLIGHT_H
+#define BLOCKLIGHT_H
+
+#include "common.h"
+#include "handleregistry.h"
+
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <deque>
+
+struct ChunkManager;
+struct Chunk;
+
+// A cell whose opacity or emission changed
+struct LightEdit {
+	u32 index; // Cell index, z + y*d + x*d*h
+	bool opaque;
+	u8 emission;
+};
+
+// Block light of one chunk. Everything but stagedEdits and the published
+//	buffer belongs to whichever worker is propagating its volume
+struct LightField {
+	ivec3 size;
+	ivec3 chunkPosition; // Chunk::positionInNeighborhood when it was added
+	std::vector<u8> light;
+	std::vector<u8> opaque;
+	std::vector<u8> emission;
+	bool dirty;
+
+	// Light including face margins taken from neighbors, laid out
+	//	like Chunk::lightData. Swapped in by workers after propagating
+	std::mutex publishMutex;
+	std::vector<u8> published;
+	std::atomic<u32> publishedVersion;
+
+	// Main thread only. Flushed to the volume once per update
+	std::vector<LightEdit> stagedEdits;
+
+	LightField(ivec3 size);
+
+	u32 Index(ivec3 p) const { return p.z + p.y*size.z + p.x*size.z*size.y; }
+	bool InBounds(ivec3 p) const;
+};
+
+// Light only travels within a neighborhood, so each neighborhood's
+//	fields are propagated together by at most one worker at a time
+struct LightVolume {
+	struct Command {
+		enum { Add, Remove, Edit };
+
+		u8 type;
+		std::shared_ptr<LightField> field;
+		std::vector<LightEdit> edits;
+	};
+
+	// Guarded by BlockLightEngine::mutex
+	std::vector<Command> commands;
+	bool queued;
+	bool busy;
+
+	// Worker only
+	std::map<u64, std::shared_ptr<LightField>> fields; // Keyed by ChunkKey
+	ivec3 chunkSize;
+
+	LightVolume();
+
+	static u64 ChunkKey(ivec3 chunkPosition);
+	LightField* GetField(ivec3 chunkPosition);
+};
+
+// Propagates block light by breadth first flood fill on worker threads.
+// Edits are incremental: placing an emitter floods out from it, and removing
+//	light clears only the cells it lit before refilling them from whatever
+//	other light borders the cleared area. Results are folded into
+//	Chunk::lightData on the main thread and meshed as stbvox lighting
+struct BlockLightEngine {
+	static constexpr u8 MaxLightLevel = 15;
+
+	struct Registration {
+		Handle<Chunk> chunk;
+		std::shared_ptr<LightField> field;
+		std::shared_ptr<LightVolume> volume;
+		ivec3 chunkPosition;
+		u32 appliedVersion;
+	};
+
+	std::vector<Registration> registrations;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<std::shared_ptr<LightVolume>> readyVolumes;
+	std::vector<std::thread> workers;
+	bool running;
+
+	BlockLightEngine();
+	~BlockLightEngine();
+
+	void Start(u32 workerCount);
+	void Stop();
+
+	// Main thread. Registers new chunks, drops destroyed or moved ones,
+	//	submits staged edits and applies finished light
+	void Update(ChunkManager*);
+
+	void Submit(std::shared_ptr<LightVolume>, LightVolume::Command&&);
+	void WorkerRun();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,88 @@
+#ifndef BLOCKPOOL_H
+#define BLOCKPOOL_H
+
+#include "common.h"
+#include <type_traits>
+#include <bitset>
+#include <new>
+
+// Slab allocator for dynamic blocks of a single type.
+// Objects never move once allocated, since Block::dynamic and overlays
+//	hold pointers to them, so slabs are never reallocated or released.
+// ForEach walks live objects slab by slab, in address order
+template<class T, u32 SlabSize = 256>
+struct BlockPool {
+	struct Slab {
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type slots[SlabSize];
+		std::bitset<SlabSize> live;
+
+		T* Get(u32 i) { return reinterpret_cast<T*>(&slots[i]); }
+		const T* Begin() const { return reinterpret_cast<const T*>(&slots[0]); }
+
+		bool Contains(const T* p) const { return p >= Begin() && p < Begin() + SlabSize; }
+		u32 IndexOf(const T* p) const { return p - Begin(); }
+	};
+
+	std::vector<std::unique_ptr<Slab>> slabs;
+	std::vector<T*> freeList;
+	u32 liveCount = 0;
+
+	BlockPool() = default;
+	BlockPool(const BlockPool&) = delete;
+
+	~BlockPool() {
+		ForEach([](T* o) { o->~T(); });
+	}
+
+	T* Allocate() {
+		if(freeList.empty()) {
+			slabs.emplace_back(new Slab);
+			auto slab = slabs.back().get();
+
+			// Reversed so that slots are handed out in address order
+			for(u32 i = SlabSize; i-- > 0;)
+				freeList.push_back(slab->Get(i));
+		}
+
+		T* p = freeList.back();
+		freeList.pop_back();
+
+		new(p) T;
+		auto slab = FindSlab(p);
+		slab->live[slab->IndexOf(p)] = true;
+		liveCount++;
+		return p;
+	}
+
+	void Free(T* p) {
+		if(!p) return;
+
+		auto slab = FindSlab(p);
+		if(!slab) throw "Tried to free dynamic block from wrong pool";
+
+		p->~T();
+		slab->live[slab->IndexOf(p)] = false;
+		freeList.push_back(p);
+		liveCount--;
+	}
+
+	template<class F>
+	void ForEach(F f) {
+		for(auto& slab: slabs) {
+			if(slab->live.none()) continue;
+
+			for(u32 i = 0; i < SlabSize; i++)
+				if(slab->live[i]) f(slab->Get(i));
+		}
+	}
+
+	// NOTE: Linear in the number of slabs, which stays small
+	Slab* FindSlab(const T* p) {
+		for(auto& slab: slabs)
+			if(slab->Contains(p)) return slab.get();
+
+		return nullptr;
+	}
+};
+
+#endif
\ No newline at end of file
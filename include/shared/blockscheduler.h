@@ -0,0 +1,42 @@
+#ifndef BLOCKSCHEDULER_H
+#define BLOCKSCHEDULER_H
+
+#include "common.h"
+
+struct DynamicBlock;
+
+// Runs DynamicBlock::Update for blocks that have asked for it.
+// Blocks are asleep by default and cost nothing until woken. Awake blocks
+//	are updated every tick, round robin, up to tickBudget per tick.
+//	Delayed wakeups wait in a timer wheel bucketed by tick.
+// Only ticked on the server
+struct BlockScheduler {
+	static constexpr u32 WheelSize = 256; // Ticks. Longer delays wait extra laps
+	static constexpr u32 DefaultTickBudget = 4096;
+
+	std::vector<DynamicBlock*> awake; // Indexed by DynamicBlock::awakeIndex
+	std::vector<DynamicBlock*> wheel[WheelSize];
+	u64 currentTick;
+	u32 cursor;
+	u32 tickBudget;
+
+	static std::shared_ptr<BlockScheduler> Get();
+
+	BlockScheduler();
+
+	// Update every tick until put to sleep. Cancels pending wakeups
+	void Wake(DynamicBlock*);
+	// Sleep for a number of ticks (at least one), then wake
+	void WakeAfter(DynamicBlock*, u32 ticks);
+	// Stop updating and cancel pending wakeups
+	void Sleep(DynamicBlock*);
+
+	bool IsScheduled(DynamicBlock*);
+
+	void Tick();
+
+	void RemoveAwake(DynamicBlock*);
+	void CancelWakeup(DynamicBlock*);
+};
+
+#endif
\ No newline at end of file
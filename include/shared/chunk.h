@@ -3,42 +3,98 @@
 
 #include "common.h"
 #include "physics.h"
+#include "handleregistry.h"
 
 struct ChunkNeighborhood;
 struct ChunkMeshBuilder;
+struct LightField;
 struct ShaderProgram;
+struct BlockInfo;
 struct Block;
+struct Chunk;
 
-// NOTE: I'm not sure about Chunk knowing about physics/numQuads
+using ChunkHandle = Handle<Chunk>;
+
+// Voxel space chunk faces, in the order used by Chunk::faceConnectivity
+namespace ChunkFace {
+	enum {
+		PosX, NegX,
+		PosY, NegY,
+		PosZ, NegZ,
+		Count
+	};
+
+	inline u8 Opposite(u8 f) { return f^1; }
+	ivec3 Direction(u8);
+}
+
+// NOTE: I'm not sure about Chunk knowing about physics
 struct Chunk {
-	RigidBody* rigidbody;
-	Collider* collider;
+	std::shared_ptr<Collider> collider; // Shared between chunks with the same contentHash
+	s32 compoundIndex; // Child index of collider in neighborhood's compound shape, or -1
 
 	Block* blocks;
 
 	u8* geometryData;
 	u8* rotationData;
 	u8* occlusionData; // NOTE: Occlusion data not needed on server side
+	u8* lightData; // Block light, 0 to BlockLightEngine::MaxLightLevel. Written by SetLightData
+
+	// Bitmask per face of faces that can be reached from it through
+	//	non-occluding voxels. Used for visibility culling
+	u8 faceConnectivity[ChunkFace::Count];
 	
-	u32 numQuads;
+	u32 voxelVersion; // Incremented whenever voxel data changes
+	u32 blocksVersion; // Incremented whenever blocks change
+
+	// See GetBlocksHash
+	u64 blocksHash;
+	u32 blocksHashVersion;
+
+	// Hash of geometry, rotation and occlusion data including margins and size.
+	// Chunks with equal hashes mesh identically, so they share meshes and colliders.
+	// Maintained per voxel by UpdateVoxelData
+	u64 contentHash;
+	// Hash of lightData, zero when unlit. Kept separate so lighting
+	//	doesn't stop colliders being shared
+	u64 lightHash;
 	u16 chunkID;
 	u8 width, height, depth;
 	bool physicsDirty;
-	bool renderDirty;
 	bool blocksDirty;
+	bool marginsDirty; // A neighbor's face opacity changed
+
+	// Summary of block contents, maintained by CreateBlock/DestroyBlock
+	//	so that whole chunks can be skipped without touching every cell
+	u32 blockCount; // Non-air blocks
+	std::map<u16, u32> blockTypeCounts;
+	u16 opaqueFaceCells[ChunkFace::Count]; // Occluding blocks on each face
+	u8 lastOpaqueFaces; // Face mask neighbors were last notified of
 
 	vec3 position;
 	quat rotation;
 
-	std::weak_ptr<Chunk> self;
+	ChunkHandle handle; // In ChunkManager::chunks
 	std::weak_ptr<ChunkNeighborhood> neighborhood;
+	std::shared_ptr<LightField> lightField; // Set while registered with the light engine
 	ivec3 positionInNeighborhood; // Multiple of {width,height,depth} in voxelspace
 
 	Chunk(u8, u8, u8);
 	~Chunk();
 
-	void GenerateCollider(std::shared_ptr<ChunkMeshBuilder>);
+	void GenerateCollider(ChunkMeshBuilder*);
 	void UpdateVoxelData();
+	void UpdateFaceConnectivity();
+
+	// Fills margin voxels bordering fully opaque neighbor faces with
+	//	solid voxels so faces against them aren't meshed
+	// Returns true if any margin voxel changed
+	bool UpdateMargins();
+
+	bool FacesConnected(u8 a, u8 b);
+
+	// Replaces lightData, including margins. Bumps voxelVersion if anything changed
+	void SetLightData(const u8*);
 	void Update();
 
 	// TODO: I'm not sure I like this
@@ -54,10 +110,49 @@ struct Chunk {
 	void DestroyBlock(ivec3, u16 playerID = 0);
 	Block* GetBlock(ivec3);
 
+	// Bulk edits. Block types are resolved once, storage is written directly
+	//	and the chunk is marked dirty once. OnBreak fires for every replaced 
+	//	dynamic block before anything changes, OnPlace for every new one after.
+	// Setting a cell to the type it already holds only changes its orientation.
+	// blockID 0 clears cells
+	struct BlockEdit {
+		ivec3 position;
+		u16 blockID;
+		u8 orientation;
+	};
+
+	// Region is [min, max), clamped to the chunk
+	void FillRegion(ivec3 min, ivec3 max, u16 blockID, u8 orientation = 0, u16 playerID = 0);
+	void FillRegion(ivec3 min, ivec3 max, const std::string&, u8 orientation = 0, u16 playerID = 0);
+	// Span of cells in storage order (z fastest, then y, then x) starting at offset.
+	//	Blocks are packed as blockID<<2 | orientation, as they are on the wire
+	void SetSpan(u32 offset, u32 count, const u16* packedBlocks, u16 playerID = 0);
+	// Edits may repeat a cell, in which case the last one wins
+	void ApplyEdits(const std::vector<BlockEdit>&, u16 playerID = 0);
+
 	ivec3 WorldToVoxelSpace(vec3);
 	vec3 VoxelToWorldSpace(ivec3);
 
 	bool InBounds(ivec3);
+
+	bool IsEmpty() const { return blockCount == 0; }
+	bool IsFull() const { return blockCount == (u32)width*height*depth; }
+	// True if every cell holds the same block type, including air
+	bool IsUniform() const;
+	// Block type filling the chunk if IsUniform, otherwise 0
+	u16 GetUniformBlockID() const;
+
+	// Bitmask of ChunkFaces made entirely of occluding blocks
+	u8 GetOpaqueFaces() const;
+	bool IsFaceOpaque(u8 f) const { return GetOpaqueFaces() & (1<<f); }
+	u32 GetFaceArea(u8 f) const;
+
+	// Hash of block types and orientations, as they're packed on the wire.
+	// Used to check whether a client's cached copy of a chunk is current.
+	// Recomputed at most once per blocksVersion
+	u64 GetBlocksHash();
+
+	void TrackBlockChange(ivec3, u16 oldID, u16 newID);
 };
 
 #endif
\ No newline at end of file
@@ -2,32 +2,104 @@
 #define CHUNKMANAGER_H
 
 #include "common.h"
+#include "physics.h"
+#include "contentcache.h"
+#include "handleregistry.h"
+
+#include <unordered_map>
 
 struct ChunkMeshBuilder;
+struct BlockLightEngine;
+struct LightVolume;
 struct Camera;
 struct Chunk;
 
+// A rigid group of chunks. Chunk colliders are children of a single compound 
+//	shape in neighborhood space, so moving the neighborhood only moves one body.
+// Bodies within its bounds are simulated in its own PhysicsSpace, against
+//	a second body sharing the same shape
 struct ChunkNeighborhood {
-	std::vector<std::weak_ptr<Chunk>> chunks;
+	std::vector<Handle<Chunk>> chunks; // In ChunkManager::chunks
+	std::unordered_map<u64, Handle<Chunk>> chunkPositions; // Keyed by PositionKey
+	Handle<ChunkNeighborhood> handle; // In ChunkManager::neighborhoods
 	ivec3 chunkSize;
 	u16 neighborhoodID;
 
 	vec3 position; // Position of chunk at vx{0,0,0}
 	quat rotation;
 
+	// Neighborhoods are dead reckoned with these, so the server only needs
+	//	to send a correction when they change or the prediction drifts
+	vec3 velocity; // Of pivot, world space
+	vec3 angularVelocity; // About pivot, world space, radians per second
+	vec3 pivot; // Neighborhood space
+
+	RigidBody* rigidbody;
+	btCompoundShape* compoundShape;
+	std::vector<Chunk*> compoundChunks; // Owner of each child of compoundShape
+	bool bodyInWorld;
+
+	// Only moving neighborhoods with colliders need a frame of their own,
+	//	so this is null otherwise. Bodies aboard fall back to the global world
+	//	when it's destroyed
+	PhysicsSpace* space;
+	// Copy of compoundShape for localBody, so that the global world and the
+	//	space share no compound shape and can be stepped on different threads.
+	//	Children are the same chunk colliders, which Bullet only reads
+	btCompoundShape* spaceShape;
+	RigidBody* localBody; // Static in space at the origin
+
+	std::shared_ptr<LightVolume> lightVolume; // Created by the light engine
+
+	ChunkNeighborhood();
+	~ChunkNeighborhood();
+
+	// Returns false if the neighborhood isn't moving
+	bool Extrapolate(f32 dt);
+	bool IsMoving() const;
+
+	static void ExtrapolatePose(vec3& position, quat& rotation, vec3 pivot,
+		vec3 velocity, vec3 angularVelocity, f32 dt);
+
+	// Also moves the rigidbody, so only call when the neighborhood has moved
 	void UpdateChunkTransforms();
-	void UpdateChunkTransform(std::shared_ptr<Chunk>);
+	void UpdateChunkTransform(Chunk*);
 
-	void AddChunk(std::shared_ptr<Chunk>);
-	void RemoveChunk(std::shared_ptr<Chunk>);
+	void AddChunk(Chunk*);
+	void RemoveChunk(Chunk*);
+
+	// Moves a chunk within the neighborhood. Chunks must be positioned through
+	//	this so that GetChunkAt can find them. Also updates its transform
+	void SetChunkPosition(Chunk*, ivec3 positionInNeighborhood);
+	static u64 PositionKey(ivec3 positionInNeighborhood);
+
+	// Chunk colliders are placed by Chunk::positionInNeighborhood
+	void SetChunkCollider(Chunk*, Collider*);
+	void RemoveChunkCollider(Chunk*);
+
+	// Creates or destroys space when the neighborhood starts or stops
+	//	moving, or gains or loses its colliders
+	void UpdateSpace();
+
+	Chunk* GetChunkAt(ivec3 positionInNeighborhood);
+	std::shared_ptr<Chunk> GetChunkContaining(vec3 world);
 };
 
+// Chunks and neighborhoods are owned by registries and referred to by
+//	handle everywhere that doesn't need to keep them alive
 struct ChunkManager {
-	std::vector<std::shared_ptr<ChunkNeighborhood>> neighborhoods;
-	std::vector<std::shared_ptr<Chunk>> chunks;
+	HandleRegistry<ChunkNeighborhood> neighborhoods;
+	HandleRegistry<Chunk> chunks;
 	std::shared_ptr<ChunkMeshBuilder> meshBuilder;
+	std::shared_ptr<BlockLightEngine> lightEngine; // Only the client lights chunks
+
+	// Keyed by Chunk::contentHash
+	ContentCache<Collider> colliderCache;
 	
 	static std::shared_ptr<ChunkManager> Get();
+	// Doesn't create the manager or keep it alive, for paths
+	//	that only run while something else holds it
+	static ChunkManager* Instance();
 
 	ChunkManager();
 	~ChunkManager();
@@ -37,11 +109,23 @@ struct ChunkManager {
 	std::shared_ptr<ChunkNeighborhood> CreateNeighborhood();
 
 	std::shared_ptr<Chunk> GetChunk(u16 id);
+
+	// Chunks are destroyed at the end of Update, so chunks being
+	//	updated or iterated over never disappear underneath their users
 	void DestroyChunk(u16 id);
+	void CollectDestroyedChunks();
+	std::vector<Handle<Chunk>> destroyedChunks;
 
 	std::shared_ptr<ChunkNeighborhood> GetNeighborhood(u16 id);
 
+	// Neighborhoods go away with their last chunk. Called wherever a chunk
+	//	leaves one, and does nothing if it still has chunks
+	void DestroyNeighborhoodIfEmpty(ChunkNeighborhood*);
+
 	void Update();
+
+	// Extrapolates moving neighborhoods and updates their chunks
+	void UpdateNeighborhoodMotion(f32 dt);
 };
 
 #endif
\ No newline at end of file
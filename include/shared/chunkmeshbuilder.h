@@ -10,10 +10,31 @@ struct ChunkMeshBuilder {
 	static constexpr u32 FaceBufferSize = 4<<20; // 4MB
 	static constexpr u32 VertexBufferSize = FaceBufferSize*4; // 16MB
 
+	// LOD n is meshed from voxels 2^n times larger than a block
+	static constexpr u8 LodCount = 3;
+
+	// Downsampled copy of a chunks voxel data, laid out the same
+	//	way as Chunk::geometryData including margins
+	struct LodGrid {
+		std::vector<u8> geometry;
+		std::vector<u8> rotation;
+		std::vector<u8> lighting;
+		u32 width, height, depth;
+	};
+
+	// stbvox lighting of open voxels with no block light. Block light
+	//	brightens linearly from here up to 255 at full strength
+	static constexpr u8 AmbientLighting = 191;
+
 	u8* vertexBuildBuffer;
 	u8* faceBuildBuffer;
 
+	// Occlusion and block light combined into stbvox's lighting input
+	std::vector<u8> lighting;
+
 	std::vector<u8> voxelGeometryMap;
+	u8 marginVoxelID; // Solid voxel with no block, see Chunk::UpdateMargins
+	LodGrid lodGrids[LodCount-1];
 
 	stbvox_mesh_maker mm;
 
@@ -22,7 +43,11 @@ struct ChunkMeshBuilder {
 	void PopulateVoxelInfo();
 
 	// Returns number of quads generated
-	u32 BuildMesh(std::shared_ptr<Chunk>);
+	// Meshes generated for lod > 0 are in downsampled voxel space
+	//	and need to be scaled by LodScale(lod) when rendered
+	u32 BuildMesh(Chunk*, u8 lod = 0);
+
+	static u32 LodScale(u8 lod) { return 1u << lod; }
 };
 
 #endif
\ No newline at end of file
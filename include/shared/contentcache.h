@@ -0,0 +1,36 @@
+#ifndef CONTENTCACHE_H
+#define CONTENTCACHE_H
+
+#include "common.h"
+#include <unordered_map>
+
+// Maps content hashes to resources shared between identical chunks.
+// The cache doesn't keep anything alive; a resource is freed when its 
+//	last user lets go of it, and the dead entry is pruned later
+template<class T>
+struct ContentCache {
+	std::unordered_map<u64, std::weak_ptr<T>> entries;
+	size_t pruneThreshold = 64;
+
+	std::shared_ptr<T> Get(u64 hash) {
+		auto it = entries.find(hash);
+		if(it == entries.end()) return nullptr;
+		return it->second.lock();
+	}
+
+	void Add(u64 hash, std::shared_ptr<T> resource) {
+		if(entries.size() >= pruneThreshold) Prune();
+		entries[hash] = resource;
+	}
+
+	void Prune() {
+		for(auto it = entries.begin(); it != entries.end();) {
+			if(it->second.expired()) it = entries.erase(it);
+			else ++it;
+		}
+
+		pruneThreshold = std::max<size_t>(64, entries.size()*2);
+	}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+#ifndef HANDLEREGISTRY_H
+#define HANDLEREGISTRY_H
+
+#include "common.h"
+
+// Refers to an object in a HandleRegistry without keeping it alive.
+// A slot's generation is bumped when its object is removed, so handles
+//	to removed objects are detected rather than finding whatever reused the slot
+template<class T>
+struct Handle {
+	u32 index;
+	u32 generation; // Never zero for an issued handle
+
+	Handle() : index{0}, generation{0} {}
+	Handle(u32 i, u32 g) : index{i}, generation{g} {}
+
+	bool IsNull() const { return generation == 0; }
+	bool operator==(const Handle& o) const { return index == o.index && generation == o.generation; }
+	bool operator!=(const Handle& o) const { return !(*this == o); }
+};
+
+// Owns objects in one dense array, so iterating them is a linear walk, and
+//	maps handles to them through a slot table, so lookups are an index and a
+//	generation compare instead of a weak_ptr lock.
+// Removal swaps the last object into the gap, so don't remove while iterating
+template<class T>
+struct HandleRegistry {
+	struct Slot {
+		u32 generation;
+		u32 objectIndex;
+	};
+
+	std::vector<std::shared_ptr<T>> objects;
+	std::vector<u32> objectSlots; // Slot of each object
+	std::vector<Slot> slots;
+	std::vector<u32> freeSlots;
+
+	Handle<T> Add(std::shared_ptr<T> object) {
+		u32 slot;
+		if(freeSlots.empty()) {
+			slot = slots.size();
+			slots.push_back(Slot{1, 0});
+		}else{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+
+		slots[slot].objectIndex = objects.size();
+		objects.push_back(std::move(object));
+		objectSlots.push_back(slot);
+
+		return Handle<T>{slot, slots[slot].generation};
+	}
+
+	// Returns false if the handle was already stale
+	bool Remove(Handle<T> h) {
+		if(!IsValid(h)) return false;
+
+		u32 idx = slots[h.index].objectIndex;
+		u32 last = objects.size()-1;
+
+		objects[idx] = std::move(objects[last]);
+		objectSlots[idx] = objectSlots[last];
+		slots[objectSlots[idx]].objectIndex = idx;
+		objects.pop_back();
+		objectSlots.pop_back();
+
+		// Skip zero on wrap so null handles never match
+		if(!++slots[h.index].generation) slots[h.index].generation = 1;
+		freeSlots.push_back(h.index);
+		return true;
+	}
+
+	void Clear() {
+		while(!objects.empty())
+			Remove(Handle<T>{objectSlots.back(), slots[objectSlots.back()].generation});
+	}
+
+	bool IsValid(Handle<T> h) const {
+		return h.index < slots.size() && h.generation && slots[h.index].generation == h.generation;
+	}
+
+	T* Get(Handle<T> h) const {
+		return IsValid(h)? objects[slots[h.index].objectIndex].get() : nullptr;
+	}
+
+	std::shared_ptr<T> GetShared(Handle<T> h) const {
+		return IsValid(h)? objects[slots[h.index].objectIndex] : nullptr;
+	}
+
+	size_t size() const { return objects.size(); }
+	bool empty() const { return objects.empty(); }
+
+	typename std::vector<std::shared_ptr<T>>::iterator begin() { return objects.begin(); }
+	typename std::vector<std::shared_ptr<T>>::iterator end() { return objects.end(); }
+	typename std::vector<std::shared_ptr<T>>::const_iterator begin() const { return objects.begin(); }
+	typename std::vector<std::shared_ptr<T>>::const_iterator end() const { return objects.end(); }
+};
+
+#endif
\ No newline at end of file
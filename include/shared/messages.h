@@ -0,0 +1,363 @@
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+#include "network.h"
+#include "regionedit.h"
+
+// Packet layouts.
+// Each message lists its fields once, in Serialize, which is instantiated
+//	with a PacketWriter to encode and a PacketReader to decode, so the two
+//	sides can't drift apart. Fields are written without padding:
+//	- Value: as is
+//	- Bits: unsigned, in a fixed number of bits
+//	- Varint: unsigned, 7 bits at a time. IDs are small, so usually 1 byte
+//	- SignedVarint: zigzag encoded Varint
+//	- ChunkCoord: voxel position in [-1, 62] per axis, which covers every
+//		position in a chunk and one either side of it, in 6 bits per axis
+//	- Array: count Values, where count has already been serialized
+
+template<class Derived>
+struct PacketStream {
+	static constexpr u32 ChunkCoordBits = 6;
+
+	Derived& Self() { return *static_cast<Derived*>(this); }
+
+	template<class T>
+	void Varint(T& v) {
+		u64 x = Derived::IsReading? 0 : (u64)v;
+		bool more = true;
+
+		for(u32 shift = 0; more && shift < sizeof(T)*8; shift += 7) {
+			u32 group = (u32)(x >> shift) & 0x7f;
+			more = (x >> shift) > 0x7f;
+			Self().Bits(group, 7);
+			Self().Flag(more);
+
+			if(Derived::IsReading) x |= (u64)group << shift;
+		}
+
+		if(Derived::IsReading) v = (T)x;
+	}
+
+	void SignedVarint(s32& v) {
+		u32 zz = ((u32)v << 1) ^ (u32)(v >> 31);
+		Varint(zz);
+		if(Derived::IsReading) v = (s32)(zz >> 1) ^ -(s32)(zz & 1);
+	}
+
+	void ChunkCoord(ivec3& v) {
+		for(u32 i = 0; i < 3; i++) {
+			u32 biased = v[i] + 1;
+			Self().Bits(biased, ChunkCoordBits);
+			if(Derived::IsReading) v[i] = (s32)biased - 1;
+		}
+	}
+
+	void SignedVarint(ivec3& v) {
+		for(u32 i = 0; i < 3; i++)
+			SignedVarint(v[i]);
+	}
+
+	template<class T>
+	void Array(std::vector<T>& v, u32 count) {
+		if(Derived::IsReading) v.resize(count);
+		for(auto& x: v) Self().Value(x);
+	}
+};
+
+struct PacketWriter : PacketStream<PacketWriter> {
+	static constexpr bool IsReading = false;
+	Packet& packet;
+
+	PacketWriter(Packet& p) : packet(p) {}
+
+	template<class T>
+	void Value(T& v) { packet.Write(v); }
+
+	void Flag(bool& v) { packet.bitstream.Write(v); }
+
+	template<class T>
+	void Bits(T& v, u32 bits) {
+		for(u32 i = 0; i < bits; i++)
+			packet.bitstream.Write((bool)((v >> i) & 1));
+	}
+};
+
+struct PacketReader : PacketStream<PacketReader> {
+	static constexpr bool IsReading = true;
+	Packet& packet;
+
+	PacketReader(Packet& p) : packet(p) {}
+
+	template<class T>
+	void Value(T& v) { packet.Read(v); }
+
+	void Flag(bool& v) { packet.bitstream.Read(v); }
+
+	template<class T>
+	void Bits(T& v, u32 bits) {
+		v = 0;
+		for(u32 i = 0; i < bits; i++) {
+			bool bit = false;
+			packet.bitstream.Read(bit);
+			v |= (T)bit << i;
+		}
+	}
+};
+
+// Writes the packet type followed by the message
+template<class M>
+void WriteMessage(Packet& p, M& msg) {
+	p.WriteType(M::Type);
+	PacketWriter w{p};
+	msg.Serialize(w);
+}
+
+// Expects the packet type to have already been read
+template<class M>
+void ReadMessage(Packet& p, M& msg) {
+	PacketReader r{p};
+	msg.Serialize(r);
+}
+
+// [S->C]
+struct RemoteJoinMessage {
+	static constexpr u8 Type = PacketType::RemoteJoin;
+
+	u16 playerID;
+	u8 reason; // 0 on join, 1 if the player was already connected
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Varint(playerID);
+		s.Bits(reason, 2);
+	}
+};
+
+// [S->C] reason is 0 on disconnect, 1 on lost connection
+struct RemoteLeaveMessage : RemoteJoinMessage {
+	static constexpr u8 Type = PacketType::RemoteLeave;
+};
+
+// [S<-C]
+struct PlayerStateMessage {
+	static constexpr u8 Type = PacketType::UpdatePlayerState;
+
+	vec3 position;
+	vec3 velocity;
+	quat orientation;
+	quat eyeOrientation;
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Value(position);
+		s.Value(velocity);
+		s.Value(orientation);
+		s.Value(eyeOrientation);
+	}
+};
+
+// [S->C]
+struct RemotePlayerStateMessage : PlayerStateMessage {
+	u16 playerID;
+	u32 tick;
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Varint(playerID);
+		s.Value(tick);
+		PlayerStateMessage::Serialize(s);
+	}
+};
+
+// [S->C] Blocks are packed as blockID<<2 | orientation
+struct SetBlockMessage {
+	static constexpr u8 Type = PacketType::SetBlock;
+
+	u16 chunkID;
+	ivec3 position;
+	u16 packedBlock;
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Varint(chunkID);
+		s.ChunkCoord(position);
+		s.Value(packedBlock);
+	}
+};
+
+// [S<-C]
+struct SetBlockRequest : SetBlockMessage {
+	u16 sequence;
+
+	template<class S>
+	void Serialize(S& s) {
+		SetBlockMessage::Serialize(s);
+		s.Value(sequence);
+	}
+};
+
+// [S->C]
+struct SetBlockAckMessage {
+	static constexpr u8 Type = PacketType::SetBlockAck;
+
+	u16 sequence;
+	bool accepted;
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Value(sequence);
+		s.Flag(accepted);
+	}
+};
+
+// [S<-C]
+struct PlayerInteractMessage {
+	static constexpr u8 Type = PacketType::PlayerInteract;
+
+	u16 chunkID;
+	ivec3 position;
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Varint(chunkID);
+		s.ChunkCoord(position);
+	}
+};
+
+// [S->C]
+struct NewChunkMessage {
+	static constexpr u8 Type = PacketType::NewChunk;
+	static constexpr u32 SizeBits = 6; // Chunks are at most 32 wide
+
+	u16 chunkID;
+	u16 neighborhoodID;
+	u8 width, height, depth;
+
+	// If the chunk has a neighborhood only positionInNeighborhood is sent,
+	//	the chunk's transform is calculated clientside from the neighborhood's
+	ivec3 positionInNeighborhood;
+	vec3 position;
+	quat rotation;
+
+	bool cached;
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Varint(chunkID);
+		s.Varint(neighborhoodID);
+		s.Bits(width, SizeBits);
+		s.Bits(height, SizeBits);
+		s.Bits(depth, SizeBits);
+
+		if(neighborhoodID) {
+			s.SignedVarint(positionInNeighborhood);
+		}else{
+			s.Value(position);
+			s.Value(rotation);
+		}
+
+		s.Flag(cached);
+	}
+};
+
+// [S->C]
+struct RemoveChunkMessage {
+	static constexpr u8 Type = PacketType::RemoveChunk;
+
+	u16 chunkID;
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Varint(chunkID);
+	}
+};
+
+// [S->C]
+struct SetChunkNeighborhoodMessage {
+	static constexpr u8 Type = PacketType::SetChunkNeighborhood;
+
+	u16 chunkID;
+	u16 neighborhoodID;
+	ivec3 positionInNeighborhood;
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Varint(chunkID);
+		s.Varint(neighborhoodID);
+		s.SignedVarint(positionInNeighborhood);
+	}
+};
+
+// [S->C]
+struct NeighborhoodTransformMessage {
+	static constexpr u8 Type = PacketType::SetNeighborhoodTransform;
+
+	u16 neighborhoodID;
+	vec3 position;
+	quat rotation;
+	vec3 velocity;
+	vec3 angularVelocity;
+	vec3 pivot;
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Varint(neighborhoodID);
+		s.Value(position);
+		s.Value(rotation);
+		s.Value(velocity);
+		s.Value(angularVelocity);
+		s.Value(pivot);
+	}
+};
+
+// [S<-C]
+struct RegionEditRequest {
+	static constexpr u8 Type = PacketType::RegionEdit;
+
+	u16 chunkID;
+	RegionEdit edit;
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Varint(chunkID);
+		s.Bits(edit.op, 3);
+		s.SignedVarint(edit.min);
+		s.SignedVarint(edit.max);
+		s.Value(edit.packedBlock);
+		s.Varint(edit.replaceID);
+		s.Varint(edit.templateID);
+	}
+};
+
+// [S->C] Clipped to one chunk. Pastes carry the blocks pasted into it
+struct RegionEditMessage : RegionEditRequest {
+	static constexpr u32 SizeBits = 6;
+
+	BlockTemplate pasted;
+
+	template<class S>
+	void Serialize(S& s) {
+		RegionEditRequest::Serialize(s);
+		if(edit.op != RegionOp::Paste) return;
+
+		s.Bits(pasted.size.x, SizeBits);
+		s.Bits(pasted.size.y, SizeBits);
+		s.Bits(pasted.size.z, SizeBits);
+		s.Array(pasted.blocks, pasted.size.x*pasted.size.y*pasted.size.z);
+	}
+};
+
+// [S->C]
+struct WorldInfoMessage {
+	static constexpr u8 Type = PacketType::WorldInfo;
+
+	u64 worldID;
+
+	template<class S>
+	void Serialize(S& s) {
+		s.Value(worldID);
+	}
+};
+
+#endif
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <raknet/PacketPriority.h>
 #include <type_traits>
 #include <queue>
+#include <map>
 
 //// Transport layer
 // Manages connections
@@ -21,11 +22,32 @@ namespace RakNet {
 	class RakPeerInterface;
 }
 
+// RakNet ordering channels. Ordered and sequenced messages only wait on earlier
+//	messages in the same channel, so unrelated traffic is kept on separate ones.
+// Everything about a chunk, including edits to it, stays on one channel so it
+//	arrives in order, but chunks are spread over many so one lost chunk
+//	packet doesn't stall the others
+namespace NetChannel {
+	enum {
+		Session, // Joins, leaves, world info, chunk requests
+		Players,
+		Neighborhoods,
+		Chunks, // First chunk channel
+		ChunkCount = 32 - Chunks, // RakNet has 32 ordering channels
+	};
+
+	// Chunk packets default to the first chunk channel, so
+	//	senders that know the chunk should use ForChunk
+	u8 ForType(u8 packetType);
+	inline u8 ForChunk(u16 chunkID) { return Chunks + chunkID % ChunkCount; }
+}
+
 struct Packet {
 	RakNet::BitStream bitstream;
 	NetworkGUID guid;
 	PacketPriority priority = HIGH_PRIORITY;
 	PacketReliability reliability = RELIABLE;
+	u8 channel = NetChannel::Session; // Set by WriteType
 
 	Packet();
 	Packet(Packet&&);
@@ -57,11 +79,36 @@ void Packet::Read(I& i) {
 }
 
 struct Network {
+	// Length of a server tick. State updates are stamped with the server tick
+	static constexpr f32 TickInterval = 0.05f;
+
+	// Payload limit of a coalesced message, a little under a typical MTU
+	static constexpr u32 BatchSize = 1200; // Bytes
+
+	// Messages with the same recipient, channel, priority and reliability
+	//	packed into a single PacketType::Batch.
+	// Batches are sent in the order they were opened, and a channel only
+	//	ever appends to its newest batch, so ordering within a channel holds
+	struct Batch {
+		NetworkGUID to;
+		PacketPriority priority;
+		PacketReliability reliability;
+		u8 channel;
+		u16 count;
+		RakNet::BitStream payload; // {u32 size, message bytes}...
+	};
+
 	RakNet::RakPeerInterface* peer;
 	std::queue<Packet> packets;
 	bool isHosting;
 	bool isConnected;
 
+	// If set, Send and Broadcast queue messages until Flush
+	bool coalesce;
+	std::vector<std::unique_ptr<Batch>> batches;
+	std::map<std::pair<NetworkGUID, u8>, u32> newestBatches; // Index into batches by recipient and channel
+	std::vector<NetworkGUID> connections; // Used to split broadcasts per recipient
+
 	static std::shared_ptr<Network> Get();
 
 	void Init();
@@ -72,8 +119,12 @@ struct Network {
 
 	void Send(const Packet&, NetworkGUID to = RakNet::UNASSIGNED_RAKNET_GUID);
 	void Broadcast(const Packet&, NetworkGUID exclude = RakNet::UNASSIGNED_RAKNET_GUID); // Only called by server
+	void Flush();
 
 	bool GetPacket(Packet*);
+
+	void Queue(const Packet&, NetworkGUID to);
+	void Unbatch(u8* data, u32 length, NetworkGUID from);
 };
 
 #endif
\ No newline at end of file
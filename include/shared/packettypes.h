@@ -6,6 +6,7 @@
 
 // Client to server doesn't send playerID
 // Server to client does
+// Layouts here are a summary, messages.h has the exact encodings
 
 namespace PacketType {
 	enum {
@@ -15,6 +16,7 @@ namespace PacketType {
 		RemoteLeave,
 
 		// [S<>C] Encodes position, velocity, orientation, eyeOrientation
+		// S->C PlayerID, u32 server tick, state...
 		UpdatePlayerState,
 
 		// [S<>C] Notify of changes to low-freq player state
@@ -27,11 +29,13 @@ namespace PacketType {
 		// [S<>C] Notify of a single block change
 		// If vxPosition is out of bounds, the block is created in the appropriate
 		//	position in a neighboring chunk
-		// ChunkID, vx position, blockID:14, orientation:2
+		// S->C ChunkID, vx position x:6,y:6,z:6, blockID:14, orientation:2
+		// S<-C ChunkID, vx position x:6,y:6,z:6, blockID:14, orientation:2, u16 sequence
 		SetBlock,
 
 		// [S->C] Notify of chunk stuff
-		// ChunkID, NeighborhoodID, size(u8,u8,u8), [positionInNeighborhood | {position, rotation} if neigh == 0]
+		// ChunkID, NeighborhoodID, size(u8,u8,u8), [positionInNeighborhood | {position, rotation} if neigh == 0],
+		//	u8 cached. If cached is set the client's cached contents are current and no ChunkDownload follows
 		NewChunk,
 		// ChunkID
 		RemoveChunk,
@@ -46,14 +50,36 @@ namespace PacketType {
 
 		// [S<>C] Set some portion of a chunk
 		// S->C ChunkID, u16 offset, u8 numBlocks, {blockID:14, orientation:2}...
-		// S<-C nothing
+		// S<-C u16 count, {ChunkID, u64 blocks hash}...
+		//	Requests contents of all chunks, except those the client already has
+		//	current copies of. Sent in reply to WorldInfo and to refresh
 		// Limit 245 blocks per packet
 		// Assumes chunk size will never exceed 32x32x32
 		ChunkDownload,
 
 		// [S<-C] Inform server of block interaction
-		// ChunkID, x:5, y:5, z:5
+		// ChunkID, x:6, y:6, z:6
 		PlayerInteract,
+
+		// [S->C] Tell a client whether its SetBlock was applied. Sent after
+		//	the resulting SetBlock broadcast, on the same ordered channel
+		// u16 sequence, u8 accepted
+		SetBlockAck,
+
+		// [S->C] Sent on join. Client chunk caches are kept per world
+		// u64 worldID
+		WorldInfo,
+
+		// [S<>C] Several messages coalesced by Network. Unpacked before they're handed out
+		// u16 count, {u32 size, message}...
+		Batch,
+
+		// [S<>C] Bulk edit of a box of blocks. See RegionEdit
+		// S<-C ChunkID, RegionEdit. Region is in the chunk's voxel space and
+		//	may extend into the rest of its neighborhood
+		// S->C ChunkID, RegionEdit clipped to the chunk, [template if paste]
+		//	One per chunk changed
+		RegionEdit,
 	};
 }
 
@@ -12,8 +12,29 @@ using RigidBody = btRigidBody;
 using RigidBodyInfo = btRigidBody::btRigidBodyConstructionInfo;
 using Collider = btCollisionShape;
 
+// A dynamics world simulated in the frame of a moving neighborhood, so that
+//	bodies aboard a ship are simulated relative to it and far from the 
+//	origin stay precise. The global world is a space with an identity frame
+struct PhysicsSpace {
+	World* world;
+	// Each space has its own, since its pools aren't thread safe and
+	//	the server steps spaces concurrently
+	btCollisionConfiguration* collisionConfig;
+	btCollisionShape* bounds; // Bodies inside these bounds belong in this space
+
+	// Frame of the space in world space
+	vec3 position {0.f};
+	quat rotation {1,0,0,0};
+
+	vec3 ToWorld(vec3 p) const { return position + rotation * p; }
+	vec3 ToLocal(vec3 p) const { return glm::inverse(rotation) * (p - position); }
+	vec3 ToWorldDir(vec3 d) const { return rotation * d; }
+	vec3 ToLocalDir(vec3 d) const { return glm::inverse(rotation) * d; }
+
+	bool Contains(vec3 world, f32 margin) const;
+};
+
 // TODO: Single collider representation
-// TODO: Multiple worlds for ships
 struct Physics {
 	struct RaycastResult {
 		RigidBody* rigidbody;
@@ -22,13 +43,38 @@ struct Physics {
 		bool hit;
 	};
 
+	// Distances from a space's bounds at which bodies enter and leave it.
+	//	Leaving is further out so that bodies don't thrash at the border
+	static constexpr f32 EnterSpaceMargin = 1.f;
+	static constexpr f32 LeaveSpaceMargin = 3.f;
+
 	static World* world;
 	static Solver* solver;
 	static Broadphase* broadphase;
 	static Dispatcher* dispatcher;
+	static btCollisionConfiguration* collisionConfig;
+	static vec3 gravity;
+
+	static PhysicsSpace globalSpace; // Wraps world
+	static std::vector<PhysicsSpace*> spaces;
+	static std::map<RigidBody*, PhysicsSpace*> bodySpaces; // Bodies moved out of globalSpace
 
 	static void Init();
+	static void Step(f32 dt);
 	static RaycastResult Raycast(vec3 begin, vec3 end);
+
+	// Returns nullptr if physics hasn't been initialised
+	static PhysicsSpace* CreateSpace(btCollisionShape* bounds);
+	static void DestroySpace(PhysicsSpace*);
+
+	// Space a body was last moved to with MoveBody, globalSpace by default
+	static PhysicsSpace* GetBodySpace(RigidBody*);
+
+	// Hands a body over to the space whose bounds it's in. 
+	//	Returns the space the body ends up in
+	static PhysicsSpace* UpdateBodySpace(RigidBody*);
+	// Converts a body's transform and velocity into another space's frame
+	static void MoveBody(RigidBody*, PhysicsSpace* to);
 };
 
 #endif
\ No newline at end of file
@@ -3,11 +3,13 @@
 
 #include "common.h"
 #include "network.h"
+#include "handleregistry.h"
 
 struct PlayerBase {
 	static constexpr f32 PlayerHeight = 1.5f;
 
 	u16 playerID;
+	Handle<PlayerBase> handle; // In PlayerManager::players
 
 	virtual void Update() {}
 	virtual void Render() {}
@@ -28,6 +30,14 @@ struct PlayerBase {
 	// Eye position should be derived from body position
 	virtual void SetEyeOrientation(quat) {}
 
+	// State received from the server, stamped with the server tick it was sent on
+	virtual void PushState(u32 /*tick*/, vec3 pos, vec3 vel, quat ori, quat eyeOri) {
+		SetPosition(pos);
+		SetVelocity(vel);
+		SetOrientation(ori);
+		SetEyeOrientation(eyeOri);
+	}
+
 	virtual bool IsNoclip() { return false; }
 	virtual void SetNoclip(bool) {}
 
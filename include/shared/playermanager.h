@@ -2,17 +2,22 @@
 #define PLAYERMANAGER_H
 
 #include "common.h"
+#include "handleregistry.h"
+
+#include <unordered_map>
 
 struct PlayerBase;
 
 struct PlayerManager {
-	std::vector<std::shared_ptr<PlayerBase>> players;
+	HandleRegistry<PlayerBase> players;
+	std::unordered_map<u16, Handle<PlayerBase>> playerIDs;
 
 	static std::shared_ptr<PlayerManager> Get();
 
 	void AddPlayer(std::shared_ptr<PlayerBase>, u16 id);
 	void RemovePlayer(u16 id);
 	std::shared_ptr<PlayerBase> GetPlayer(u16 id);
+	PlayerBase* GetPlayer(Handle<PlayerBase>);
 
 	void Update();
 	void Render();
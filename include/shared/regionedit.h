@@ -0,0 +1,56 @@
+#ifndef REGIONEDIT_H
+#define REGIONEDIT_H
+
+#include "common.h"
+
+struct Chunk;
+
+namespace RegionOp {
+	enum {
+		Fill, // Sets every cell to the block
+		Hollow, // Sets the faces of the box to the block and clears the inside
+		Replace, // Sets cells holding replaceID to the block
+		Copy, // Stores the region in a template. Nothing changes, so it isn't replicated
+		Paste, // Writes a template with its origin at min
+		Count
+	};
+}
+
+// A stored box of blocks, packed as blockID<<2 | orientation
+//	in storage order (z fastest, then y, then x)
+struct BlockTemplate {
+	ivec3 size {0};
+	std::vector<u16> blocks;
+
+	void Resize(ivec3);
+	u32 Index(ivec3 p) const { return p.z + p.y*size.z + p.x*size.z*size.y; }
+	bool IsEmpty() const { return blocks.empty(); }
+};
+
+// Region is [min, max) in the voxel space of the chunk it's applied to.
+// Regions can extend past the chunk, so the same edit can be applied to
+//	every chunk of a neighborhood by moving the region into each chunk's space
+struct RegionEdit {
+	u8 op;
+	ivec3 min, max;
+	u16 packedBlock; // blockID<<2 | orientation
+	u16 replaceID;
+	u16 templateID; // 0 is the editing player's own clipboard
+
+	RegionEdit Offset(ivec3) const;
+	u64 Volume() const;
+};
+
+// Clamps [min, max) to a chunk. Returns false if they don't overlap
+bool ClipRegion(Chunk*, ivec3 min, ivec3 max, ivec3& clippedMin, ivec3& clippedMax);
+
+// Applies the part of an edit that overlaps a chunk as a single bulk edit.
+// Paste takes its size from the template, which it requires
+// Returns false if nothing overlapped
+bool ApplyRegionEdit(Chunk*, const RegionEdit&, const BlockTemplate* = nullptr, u16 playerID = 0);
+
+// Copies the part of [min, max) that overlaps a chunk into a template
+//	with its origin at min. The template must already be sized
+void CopyRegion(Chunk*, ivec3 min, ivec3 max, BlockTemplate&);
+
+#endif
\ No newline at end of file
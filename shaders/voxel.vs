@@ -3,10 +3,13 @@
 in uint attr_vertex;
 
 uniform usamplerBuffer facearray;
+uniform usamplerBuffer pagetable; // Arena page -> mesh slot
+uniform usamplerBuffer instancebases; // Mesh slot -> first model matrix
+uniform samplerBuffer modelarray;
+uniform int pagesize;
 // uniform vec3 transform[3];
 // uniform vec4 camera_pos;
 uniform vec3 normal_table[32];
-uniform mat4 model;
 uniform mat4 viewProjection;
 
 flat out uvec4  facedata;
@@ -16,9 +19,19 @@ flat out uvec4  facedata;
 	 out float  amb_occ;
 
 void main() {
+	// gl_VertexID includes basevertex, so this indexes the whole arena
 	int faceID = gl_VertexID >> 2;
 	facedata = texelFetch(facearray, faceID);
 
+	// Identical chunks share a mesh and are drawn instanced
+	int meshSlot = int(texelFetch(pagetable, faceID / pagesize).r);
+	int instance = int(texelFetch(instancebases, meshSlot).r) + gl_InstanceID;
+	mat4 model = mat4(
+		texelFetch(modelarray, instance*4 + 0),
+		texelFetch(modelarray, instance*4 + 1),
+		texelFetch(modelarray, instance*4 + 2),
+		texelFetch(modelarray, instance*4 + 3));
+
 	vec3 offset;
 	offset.x = float( (attr_vertex       ) & 127u );
 	offset.y = float( (attr_vertex >>  7u) & 127u );
@@ -0,0 +1,161 @@
+#include "chunkmanager.h"
+#include "chunkcache.h"
+#include "block.h"
+#include "chunk.h"
+
+#include <fstream>
+#include <sstream>
+
+static Log logger{"ChunkCache"};
+
+static constexpr u32 CacheMagic = 0x31434356; // "VCC1"
+
+std::shared_ptr<ChunkCache> ChunkCache::Get() {
+	static std::weak_ptr<ChunkCache> wp;
+	std::shared_ptr<ChunkCache> p;
+
+	if(!(p = wp.lock()))
+		wp = (p = std::make_shared<ChunkCache>());
+
+	return p;
+}
+
+ChunkCache::ChunkCache() : worldID{0}, hasWorld{false}, dirty{false}, saveTimer{0.f} {}
+
+void ChunkCache::SetWorld(u64 id) {
+	if(hasWorld && id == worldID) return;
+	if(hasWorld && dirty) Save();
+
+	entries.clear();
+	storedVersions.clear();
+
+	worldID = id;
+	hasWorld = true;
+	dirty = false;
+
+	if(Load())
+		logger << "Loaded " << entries.size() << " cached chunks";
+}
+
+bool ChunkCache::Restore(std::shared_ptr<Chunk> ch) {
+	auto it = entries.find(ch->chunkID);
+	if(it == entries.end()) return false;
+
+	auto& entry = it->second;
+	if(entry.width != ch->width || entry.height != ch->height || entry.depth != ch->depth)
+		return false;
+
+	ch->SetSpan(0, entry.blocks.size(), entry.blocks.data());
+	storedVersions[ch->chunkID] = ch->blocksVersion;
+	return true;
+}
+
+void ChunkCache::Store(std::shared_ptr<Chunk> ch) {
+	if(!hasWorld || !ch->chunkID) return;
+
+	auto& version = storedVersions[ch->chunkID];
+	if(version == ch->blocksVersion) return;
+	version = ch->blocksVersion;
+
+	auto& entry = entries[ch->chunkID];
+	entry.width = ch->width;
+	entry.height = ch->height;
+	entry.depth = ch->depth;
+	entry.hash = ch->GetBlocksHash();
+
+	u32 numBlocks = ch->width*ch->height*ch->depth;
+	entry.blocks.resize(numBlocks);
+	for(u32 i = 0; i < numBlocks; i++) {
+		auto& b = ch->blocks[i];
+		entry.blocks[i] = b.IsValid()? (b.blockID << 2 | b.orientation) : 0;
+	}
+
+	dirty = true;
+}
+
+void ChunkCache::Update(f32 dt, std::shared_ptr<ChunkManager> chunkManager) {
+	saveTimer += dt;
+	if(saveTimer < SaveInterval) return;
+	saveTimer = 0.f;
+
+	Flush(chunkManager);
+}
+
+void ChunkCache::Flush(std::shared_ptr<ChunkManager> chunkManager) {
+	if(!hasWorld) return;
+
+	for(auto& ch: chunkManager->chunks)
+		Store(ch);
+
+	if(dirty) Save();
+}
+
+bool ChunkCache::Load() {
+	std::ifstream file{GetFilename(), std::ifstream::binary};
+	if(!file) return false;
+
+	u32 magic = 0, count = 0;
+	u64 fileWorldID = 0;
+	file.read((char*)&magic, sizeof(magic));
+	file.read((char*)&fileWorldID, sizeof(fileWorldID));
+	file.read((char*)&count, sizeof(count));
+
+	if(!file || magic != CacheMagic || fileWorldID != worldID) {
+		logger << "Ignoring invalid cache " << GetFilename();
+		return false;
+	}
+
+	for(u32 i = 0; i < count; i++) {
+		u16 chunkID;
+		Entry entry;
+
+		file.read((char*)&chunkID, sizeof(chunkID));
+		file.read((char*)&entry.width, sizeof(entry.width));
+		file.read((char*)&entry.height, sizeof(entry.height));
+		file.read((char*)&entry.depth, sizeof(entry.depth));
+		file.read((char*)&entry.hash, sizeof(entry.hash));
+
+		entry.blocks.resize(entry.width*entry.height*entry.depth);
+		file.read((char*)entry.blocks.data(), entry.blocks.size()*sizeof(u16));
+
+		if(!file) {
+			logger << "Cache " << GetFilename() << " is truncated";
+			break;
+		}
+
+		entries[chunkID] = std::move(entry);
+	}
+
+	return true;
+}
+
+void ChunkCache::Save() {
+	std::ofstream file{GetFilename(), std::ofstream::binary | std::ofstream::trunc};
+	if(!file) {
+		logger << "Failed to write " << GetFilename();
+		return;
+	}
+
+	u32 count = entries.size();
+	file.write((const char*)&CacheMagic, sizeof(CacheMagic));
+	file.write((const char*)&worldID, sizeof(worldID));
+	file.write((const char*)&count, sizeof(count));
+
+	for(auto& kv: entries) {
+		auto& entry = kv.second;
+		file.write((const char*)&kv.first, sizeof(kv.first));
+		file.write((const char*)&entry.width, sizeof(entry.width));
+		file.write((const char*)&entry.height, sizeof(entry.height));
+		file.write((const char*)&entry.depth, sizeof(entry.depth));
+		file.write((const char*)&entry.hash, sizeof(entry.hash));
+		file.write((const char*)entry.blocks.data(), entry.blocks.size()*sizeof(u16));
+	}
+
+	dirty = false;
+}
+
+std::string ChunkCache::GetFilename() const {
+	std::stringstream ss;
+	ss << "chunks_" << std::hex << worldID << ".cache";
+	return ss.str();
+}
@@ -0,0 +1,145 @@
+#include "chunkmesharena.h"
+
+static Log logger{"ChunkMeshArena"};
+
+// stbvox mode 1 emits one u32 per vertex and one u32 per face
+static constexpr u32 VertexBytesPerQuad = 4*sizeof(u32);
+static constexpr u32 FaceBytesPerQuad = sizeof(u32);
+
+ChunkMeshArena::ChunkMeshArena() : pageCount{0},
+	vertexBO{0}, faceBO{0}, faceTex{0}, pageTableBO{0}, pageTableTex{0} {
+
+	glGenTextures(1, &faceTex);
+	glGenTextures(1, &pageTableTex);
+	glGenBuffers(1, &pageTableBO);
+
+	Grow(InitialPageCount);
+}
+
+ChunkMeshArena::~ChunkMeshArena() {
+	glDeleteTextures(1, &faceTex);
+	glDeleteTextures(1, &pageTableTex);
+	glDeleteBuffers(1, &vertexBO);
+	glDeleteBuffers(1, &faceBO);
+	glDeleteBuffers(1, &pageTableBO);
+}
+
+auto ChunkMeshArena::Allocate(u32 numQuads, u16 meshSlot) -> Allocation {
+	Allocation alloc;
+	if(!numQuads) return alloc;
+
+	u32 numPages = (numQuads + PageSize - 1) / PageSize;
+
+	// First fit. Chunks are small and similarly sized, so this
+	//	doesn't fragment as much as you'd think
+	auto it = std::find_if(freeList.begin(), freeList.end(), [numPages](const Allocation& a) {
+		return a.numPages >= numPages;
+	});
+
+	if(it == freeList.end()) {
+		Grow(numPages);
+		return Allocate(numQuads, meshSlot);
+	}
+
+	alloc.firstPage = it->firstPage;
+	alloc.numPages = numPages;
+
+	it->firstPage += numPages;
+	it->numPages -= numPages;
+	if(!it->numPages) freeList.erase(it);
+
+	std::fill_n(pageTable.begin() + alloc.firstPage, numPages, meshSlot);
+	pageTableDirty = true;
+
+	return alloc;
+}
+
+void ChunkMeshArena::Free(Allocation alloc) {
+	if(!alloc.IsValid()) return;
+
+	auto it = std::lower_bound(freeList.begin(), freeList.end(), alloc,
+		[](const Allocation& a, const Allocation& b) {
+			return a.firstPage < b.firstPage;
+	});
+
+	it = freeList.insert(it, alloc);
+
+	// Coalesce with following range
+	auto next = it+1;
+	if(next != freeList.end() && it->firstPage + it->numPages == next->firstPage) {
+		it->numPages += next->numPages;
+		freeList.erase(next);
+	}
+
+	// Coalesce with preceding range
+	if(it != freeList.begin()) {
+		auto prev = it-1;
+		if(prev->firstPage + prev->numPages == it->firstPage) {
+			prev->numPages += it->numPages;
+			freeList.erase(it);
+		}
+	}
+}
+
+void ChunkMeshArena::Upload(const Allocation& alloc, u32 numQuads, const u8* vertexData, const u8* faceData) {
+	if(!alloc.IsValid() || !numQuads) return;
+	if(numQuads > alloc.numPages*PageSize) throw "Chunk mesh upload overflows allocation";
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBO);
+	glBufferSubData(GL_ARRAY_BUFFER, alloc.FirstQuad()*VertexBytesPerQuad, numQuads*VertexBytesPerQuad, vertexData);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, faceBO);
+	glBufferSubData(GL_TEXTURE_BUFFER, alloc.FirstQuad()*FaceBytesPerQuad, numQuads*FaceBytesPerQuad, faceData);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ChunkMeshArena::Update() {
+	if(!pageTableDirty) return;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, pageTableBO);
+	glBufferData(GL_TEXTURE_BUFFER, pageTable.size()*sizeof(u16), &pageTable[0], GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	pageTableDirty = false;
+}
+
+void ChunkMeshArena::Grow(u32 minPages) {
+	u32 oldPageCount = pageCount;
+	u32 newPageCount = std::max(pageCount*2, pageCount + minPages);
+
+	auto resize = [oldPageCount, newPageCount](u32& bo, u32 bytesPerQuad) {
+		u32 nbo;
+		glGenBuffers(1, &nbo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, nbo);
+		glBufferData(GL_COPY_WRITE_BUFFER, newPageCount*PageSize*bytesPerQuad, nullptr, GL_DYNAMIC_DRAW);
+
+		if(bo) {
+			glBindBuffer(GL_COPY_READ_BUFFER, bo);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldPageCount*PageSize*bytesPerQuad);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glDeleteBuffers(1, &bo);
+		}
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		bo = nbo;
+	};
+
+	resize(vertexBO, VertexBytesPerQuad);
+	resize(faceBO, FaceBytesPerQuad);
+
+	// faceBO has been replaced so the texture needs rebinding
+	glBindTexture(GL_TEXTURE_BUFFER, faceTex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8UI, faceBO);
+	glBindTexture(GL_TEXTURE_BUFFER, pageTableTex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, pageTableBO);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	pageTable.resize(newPageCount, 0);
+	pageTableDirty = true;
+	pageCount = newPageCount;
+
+	Free(Allocation{oldPageCount, newPageCount-oldPageCount});
+
+	logger << "Grew to " << newPageCount << " pages (" << newPageCount*PageSize << " quads)";
+}
@@ -10,6 +10,18 @@
 
 static Log logger{"ChunkRenderer"};
 
+// Camera distance at which each lod takes over, and how far past
+//	that boundary the camera has to move before switching back
+static const f32 LodDistances[ChunkMeshBuilder::LodCount] = {0.f, 96.f, 192.f};
+static const f32 LodHysteresis = 12.f;
+
+static u8 SelectLod(u8 current, f32 distance) {
+	u8 lod = current;
+	while(lod+1 < ChunkMeshBuilder::LodCount && distance > LodDistances[lod+1] + LodHysteresis) lod++;
+	while(lod > 0 && distance < LodDistances[lod] - LodHysteresis) lod--;
+	return lod;
+}
+
 ChunkRenderer::ChunkRenderer() {
 	textureArray = CreateTextureArrayFromAtlas("textures/atlas.png", 16, 16);
 	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
@@ -40,15 +52,41 @@ ChunkRenderer::ChunkRenderer() {
 		}
 	}
 
+	// Margin voxels are never meshed, but keep the table the same size as the geometry map
+	voxelTextures.insert(voxelTextures.end(), 6, 0);
+
 	auto meshBuilder = ChunkManager::Get()->meshBuilder;
 	auto vinput = stbvox_get_input_description(&meshBuilder->mm);
 	vinput->block_tex1_face = (u8(*)[6]) &voxelTextures[0];
+
+	arena.reset(new ChunkMeshArena{});
+	meshSlotCount = 0;
+
+	glGenBuffers(1, &modelBO);
+	glGenTextures(1, &modelTex);
+	glBindTexture(GL_TEXTURE_BUFFER, modelTex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, modelBO);
+
+	glGenBuffers(1, &instanceBaseBO);
+	glGenTextures(1, &instanceBaseTex);
+	glBindTexture(GL_TEXTURE_BUFFER, instanceBaseTex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, instanceBaseBO);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
 }
 
 ChunkRenderer::~ChunkRenderer() {
+	// Meshes release themselves into the arena, so they have to go first
+	chunkRenderInfoMap.clear();
+
 	glDeleteTextures(1, &textureArray);
+	glDeleteTextures(1, &modelTex);
+	glDeleteTextures(1, &instanceBaseTex);
+	glDeleteBuffers(1, &modelBO);
+	glDeleteBuffers(1, &instanceBaseBO);
 }
 
+ChunkRenderInfo::ChunkRenderInfo() : voxelVersion{0}, currentLod{0} {}
+
 void ChunkRenderer::Render() {
 	auto chunkManager = ChunkManager::Get();
 
@@ -71,97 +109,168 @@ void ChunkRenderer::Render() {
 		glUniform4fv(program->GetUniform(sui.name), sui.array_length, &data[0].x);
 	}
 
-	glActiveTexture(GL_TEXTURE0 + 1);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
-	glUniform1i(program->GetUniform("tex_array"), 1);
-
-	glActiveTexture(GL_TEXTURE0);
-
-	if(auto cam = Camera::mainCamera.lock()) {
+	auto cam = Camera::mainCamera.lock();
+	if(cam) {
 		cam->UpdateMatrices();
 		cam->SetUniforms(program.get());
 	}
-	
+
+	// Release meshes held by chunks that no longer exist
+	for(auto it = chunkRenderInfoMap.begin(); it != chunkRenderInfoMap.end();) {
+		if(it->second.chunk.expired()) it = chunkRenderInfoMap.erase(it);
+		else ++it;
+	}
+
+	if(cam) visibility.Update(cam->position);
+
+	frameMeshes.clear();
+
 	for(auto& vc: chunkManager->chunks) {
 		auto renderInfo = &chunkRenderInfoMap[vc->chunkID];
+		renderInfo->chunk = vc;
 
-		if(vc->renderDirty) {
-			renderInfo->Update(vc);
-			vc->renderDirty = false;
+		// Nothing to draw. Dropping the meshes frees their arena space
+		if(vc->IsEmpty()) {
+			for(auto& lodMesh: renderInfo->lods) lodMesh.reset();
+			continue;
 		}
 
-		if(!renderInfo->numQuads) continue;
+		// Skip chunks hidden behind other chunks. Their meshes stay cached
+		if(cam && !visibility.IsVisible(vc.get())) continue;
+
+		if(cam) {
+			auto center = vc->VoxelToWorldSpace(ivec3{vc->width, vc->height, vc->depth}/2);
+			renderInfo->currentLod = SelectLod(renderInfo->currentLod, glm::length(center - cam->position));
+		}
 
-		glBindBuffer(GL_ARRAY_BUFFER, renderInfo->vertexBO);
-		glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, 4, nullptr);
+		// Chunk has changed, so it may no longer match the meshes it shares
+		if(renderInfo->voxelVersion != vc->voxelVersion) {
+			for(auto& lodMesh: renderInfo->lods) lodMesh.reset();
+			renderInfo->voxelVersion = vc->voxelVersion;
+		}
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_BUFFER, renderInfo->faceTex);
-		glUniform1i(program->GetUniform("facearray"), 0);
+		u8 lod = renderInfo->currentLod;
+		auto& mesh = renderInfo->lods[lod];
+		if(!mesh) mesh = GetMesh(vc.get(), lod);
+		if(!mesh->numQuads) continue;
 
+		// Lod meshes are in downsampled voxel space. Voxel coordinates start at 1
+		//	because of the margin, so scale about that rather than the origin
+		f32 scale = ChunkMeshBuilder::LodScale(lod);
 		auto modelMatrix = glm::translate(vc->position) * glm::mat4_cast(vc->rotation);
-		glUniformMatrix4fv(program->GetUniform("model"), 1, false, glm::value_ptr(modelMatrix));
+		if(lod) modelMatrix = modelMatrix * glm::translate(vec3{1.f-scale, 1.f-scale, scale-1.f}) * glm::scale(vec3{scale});
 
-		QuadElementBuffer::Draw(renderInfo->numQuads);
+		if(mesh->instances.empty()) frameMeshes.push_back(mesh.get());
+		mesh->instances.push_back(modelMatrix);
 	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindTexture(GL_TEXTURE_BUFFER, 0);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
-}
+	if(frameMeshes.empty()) return;
 
+	// Lay out instances contiguously per mesh
+	instanceMatrices.clear();
+	instanceBases.resize(meshSlotCount, 0);
+	drawCounts.clear();
+	drawBaseVertices.clear();
+	u32 maxQuads = 0;
 
-/*
-	                                                                                                      
-	88888888ba                                 88                       88               ad88             
-	88      "8b                                88                       88              d8"               
-	88      ,8P                                88                       88              88                
-	88aaaaaa8P' ,adPPYba, 8b,dPPYba,   ,adPPYb,88  ,adPPYba, 8b,dPPYba, 88 8b,dPPYba, MM88MMM ,adPPYba,   
-	88""""88'  a8P_____88 88P'   `"8a a8"    `Y88 a8P_____88 88P'   "Y8 88 88P'   `"8a  88   a8"     "8a  
-	88    `8b  8PP""""""" 88       88 8b       88 8PP""""""" 88         88 88       88  88   8b       d8  
-	88     `8b "8b,   ,aa 88       88 "8a,   ,d88 "8b,   ,aa 88         88 88       88  88   "8a,   ,a8"  
-	88      `8b `"Ybbd8"' 88       88  `"8bbdP"Y8  `"Ybbd8"' 88         88 88       88  88    `"YbbdP"'   
-	                                                                                                      
-	                                                                                                      
-*/
-
-ChunkRenderInfo::ChunkRenderInfo() : vertexBO{0}, faceBO{0}, faceTex{0} {}
-ChunkRenderInfo::ChunkRenderInfo(ChunkRenderInfo&& o) {
-	vertexBO = o.vertexBO;
-	faceTex = o.faceTex;
-	faceBO = o.faceBO;
-
-	o.vertexBO = 0;
-	o.faceTex = 0;
-	o.faceBO = 0;
-}
+	for(auto mesh: frameMeshes) {
+		instanceBases[mesh->meshSlot] = instanceMatrices.size();
+		instanceMatrices.insert(instanceMatrices.end(), mesh->instances.begin(), mesh->instances.end());
 
-ChunkRenderInfo::~ChunkRenderInfo() {
-	glDeleteBuffers(1, &vertexBO);
-	glDeleteBuffers(1, &faceBO);
-	glDeleteTextures(1, &faceTex);
-}
+		if(mesh->instances.size() == 1) {
+			drawCounts.push_back(mesh->numQuads*6);
+			drawBaseVertices.push_back(mesh->allocation.FirstQuad()*4);
+			maxQuads = std::max(maxQuads, mesh->numQuads);
+		}
+	}
 
-void ChunkRenderInfo::Update(std::shared_ptr<Chunk> vc) {
-	auto manager = ChunkManager::Get();
-	auto meshBuilder = manager->meshBuilder;
-	numQuads = meshBuilder->BuildMesh(vc);
+	arena->Update();
 
-	if(!vertexBO) glGenBuffers(1, &vertexBO);
-	if(!faceBO) glGenBuffers(1, &faceBO);
+	// Orphan and refill, this is small compared to the meshes themselves
+	glBindBuffer(GL_TEXTURE_BUFFER, modelBO);
+	glBufferData(GL_TEXTURE_BUFFER, instanceMatrices.size()*sizeof(mat4), &instanceMatrices[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, instanceBaseBO);
+	glBufferData(GL_TEXTURE_BUFFER, instanceBases.size()*sizeof(u32), &instanceBases[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBO);
-	glBufferData(GL_ARRAY_BUFFER, vc->numQuads*4*sizeof(u32), meshBuilder->vertexBuildBuffer, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0 + 1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	glUniform1i(program->GetUniform("tex_array"), 1);
 
-	glBindBuffer(GL_TEXTURE_BUFFER, faceBO);
-	glBufferData(GL_TEXTURE_BUFFER, vc->numQuads*sizeof(u32), meshBuilder->faceBuildBuffer, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0 + 2);
+	glBindTexture(GL_TEXTURE_BUFFER, arena->pageTableTex);
+	glUniform1i(program->GetUniform("pagetable"), 2);
+
+	glActiveTexture(GL_TEXTURE0 + 3);
+	glBindTexture(GL_TEXTURE_BUFFER, modelTex);
+	glUniform1i(program->GetUniform("modelarray"), 3);
+
+	glActiveTexture(GL_TEXTURE0 + 4);
+	glBindTexture(GL_TEXTURE_BUFFER, instanceBaseTex);
+	glUniform1i(program->GetUniform("instancebases"), 4);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, arena->faceTex);
+	glUniform1i(program->GetUniform("facearray"), 0);
+
+	glUniform1i(program->GetUniform("pagesize"), ChunkMeshArena::PageSize);
+
+	glBindBuffer(GL_ARRAY_BUFFER, arena->vertexBO);
+	glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, 4, nullptr);
+
+	QuadElementBuffer::MultiDraw(maxQuads, drawCounts.data(), drawBaseVertices.data(), drawCounts.size());
+
+	for(auto mesh: frameMeshes) {
+		if(mesh->instances.size() > 1)
+			QuadElementBuffer::DrawInstanced(mesh->numQuads, mesh->allocation.FirstQuad()*4, mesh->instances.size());
+
+		mesh->instances.clear();
+	}
 
-	if(!faceTex) {
-		glGenTextures(1, &faceTex);
-		glBindTexture(GL_TEXTURE_BUFFER, faceTex);
-		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8UI, faceBO);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	for(u32 i = 4; i > 0; i--) {
+		glActiveTexture(GL_TEXTURE0 + i);
 		glBindTexture(GL_TEXTURE_BUFFER, 0);
 	}
+
+	glActiveTexture(GL_TEXTURE0 + 1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+std::shared_ptr<ChunkMesh> ChunkRenderer::GetMesh(Chunk* vc, u8 lod) {
+	u64 key = vc->contentHash + vc->lightHash + lod * 0x9e3779b97f4a7c15ull;
+	if(auto mesh = meshCache.Get(key)) return mesh;
+
+	u16 meshSlot;
+	if(freeMeshSlots.empty()) {
+		if(meshSlotCount > std::numeric_limits<u16>::max())
+			throw "Ran out of chunk mesh slots";
+
+		meshSlot = meshSlotCount++;
+	}else{
+		meshSlot = freeMeshSlots.back();
+		freeMeshSlots.pop_back();
+	}
+
+	auto meshBuilder = ChunkManager::Get()->meshBuilder;
+	u32 numQuads = meshBuilder->BuildMesh(vc, lod);
+
+	// Give the arena space and the slot back when the last chunk lets go
+	auto mesh = std::shared_ptr<ChunkMesh>(new ChunkMesh{}, [this](ChunkMesh* m) {
+		arena->Free(m->allocation);
+		freeMeshSlots.push_back(m->meshSlot);
+		delete m;
+	});
+
+	mesh->meshSlot = meshSlot;
+	mesh->numQuads = numQuads;
+	mesh->allocation = arena->Allocate(numQuads, meshSlot);
+	arena->Upload(mesh->allocation, numQuads, meshBuilder->vertexBuildBuffer, meshBuilder->faceBuildBuffer);
+
+	meshCache.Add(key, mesh);
+	return mesh;
 }
@@ -0,0 +1,111 @@
+#include "chunkvisibility.h"
+#include "chunkmanager.h"
+#include "chunk.h"
+
+#include <queue>
+
+static u64 GridKey(ivec3 p) {
+	return (u64)(u16)p.x << 32 | (u64)(u16)p.y << 16 | (u64)(u16)p.z;
+}
+
+void ChunkVisibility::Update(vec3 cameraPosition) {
+	auto chunkManager = ChunkManager::Get();
+	visibleChunks.clear();
+
+	for(auto& neigh: chunkManager->neighborhoods)
+		UpdateNeighborhood(neigh.get(), cameraPosition);
+
+	// Lone chunks have nothing to hide behind
+	for(auto& ch: chunkManager->chunks) {
+		if(ch->neighborhood.expired())
+			visibleChunks.insert(ch.get());
+	}
+}
+
+bool ChunkVisibility::IsVisible(const Chunk* ch) {
+	return visibleChunks.count(ch) > 0;
+}
+
+void ChunkVisibility::UpdateNeighborhood(ChunkNeighborhood* neigh, vec3 cameraPosition) {
+	struct Step {
+		Chunk* chunk;
+		u8 entryFace; // ChunkFace::Count if the camera is inside
+		u8 directions; // Directions travelled to get here
+	};
+
+	grid.clear();
+	auto& registry = ChunkManager::Instance()->chunks;
+	for(auto h: neigh->chunks) {
+		if(auto ch = registry.Get(h))
+			grid[GridKey(ch->positionInNeighborhood)] = ch;
+	}
+
+	auto GetNeighbor = [this](Chunk* ch, u8 face) -> Chunk* {
+		auto it = grid.find(GridKey(ch->positionInNeighborhood + ChunkFace::Direction(face)));
+		return (it == grid.end())? nullptr : it->second;
+	};
+
+	std::queue<Step> queue;
+	std::unordered_set<const Chunk*> visited;
+
+	// If the camera is inside a chunk, start there. Otherwise start from every
+	//	face on the outside of the neighborhood that faces the camera
+	Chunk* cameraChunk = nullptr;
+	for(auto& kv: grid) {
+		if(kv.second->InBounds(kv.second->WorldToVoxelSpace(cameraPosition))) {
+			cameraChunk = kv.second;
+			break;
+		}
+	}
+
+	if(cameraChunk) {
+		queue.push(Step{cameraChunk, ChunkFace::Count, 0});
+
+	}else for(auto& kv: grid) {
+		auto ch = kv.second;
+		auto vxcam = ch->WorldToVoxelSpace(cameraPosition);
+		ivec3 size {ch->width, ch->height, ch->depth};
+
+		for(u8 f = 0; f < ChunkFace::Count; f++) {
+			if(GetNeighbor(ch, f)) continue;
+
+			// Is the camera on the outside of this face
+			auto dir = ChunkFace::Direction(f);
+			u8 axis = f/2;
+			bool facing = (dir[axis] > 0)? (vxcam[axis] >= size[axis]) : (vxcam[axis] < 0);
+			if(!facing) continue;
+
+			// Edge and corner chunks are entered through every face
+			//	that faces the camera, since each connects to different faces
+			queue.push(Step{ch, f, (u8)(1 << ChunkFace::Opposite(f))});
+		}
+	}
+
+	// Seeds are only marked once they've all been queued, so that one
+	//	entry face doesn't keep out the rest
+	auto seeds = queue;
+	while(!seeds.empty()) {
+		visited.insert(seeds.front().chunk);
+		seeds.pop();
+	}
+
+	while(!queue.empty()) {
+		auto step = queue.front();
+		queue.pop();
+
+		visibleChunks.insert(step.chunk);
+
+		for(u8 f = 0; f < ChunkFace::Count; f++) {
+			// Never head back towards the camera
+			if(step.directions & (1 << ChunkFace::Opposite(f))) continue;
+
+			if(step.entryFace != ChunkFace::Count 
+			&& !step.chunk->FacesConnected(step.entryFace, f)) continue;
+
+			auto next = GetNeighbor(step.chunk, f);
+			if(!next || !visited.insert(next).second) continue;
+
+			queue.push(Step{next, ChunkFace::Opposite(f), (u8)(step.directions | 1 << f)});
+		}
+	}
+}
\ No newline at end of file
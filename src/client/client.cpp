@@ -11,6 +11,8 @@
 #include "debugdraw.h"
 #include "localplayer.h"
 #include "chunkmanager.h"
+#include "chunkcache.h"
+#include "blocklight.h"
 #include "playermanager.h"
 #include "chunkrenderer.h"
 #include "bullethelpers.h"
@@ -95,6 +97,9 @@ void Client::Init() {
 	Camera::mainCamera = camera;
 
 	chunkManager = ChunkManager::Get();
+	chunkManager->lightEngine = std::make_shared<BlockLightEngine>();
+	chunkManager->lightEngine->Start(std::max<s32>((s32)std::thread::hardware_concurrency()/2 - 1, 1));
+	chunkCache = ChunkCache::Get();
 	overlayManager = OverlayManager::Get();
 
 	Debug::Init();
@@ -229,7 +234,8 @@ void Client::Run() {
 		}
 
 		if(Input::GetKeyDown(SDLK_DELETE)) {
-			chunkManager->chunks.clear();
+			for(auto& ch: chunkManager->chunks)
+				chunkManager->destroyedChunks.push_back(ch->handle);
 		}
 
 		ClientNetInterface::Update(network);
@@ -243,10 +249,12 @@ void Client::Run() {
 
 		playerManager->Update();
 		chunkManager->Update();
+		chunkManager->UpdateNeighborhoodMotion(Time::dt);
+		chunkCache->Update(Time::dt, chunkManager);
 		overlayManager->Update();
 		gui->Update();
 
-		Physics::world->stepSimulation((btScalar)Time::dt, 10);
+		Physics::Step(Time::dt);
 
 		glClearColor(0.1,0.1,0.1,0);
 		glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
@@ -273,6 +281,8 @@ void Client::Run() {
 		begin = end;
 	}
 
+	chunkCache->Flush(chunkManager);
+	chunkManager->lightEngine->Stop();
 	network->Shutdown();
 }
 
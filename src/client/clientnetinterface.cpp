@@ -1,14 +1,54 @@
 #include "clientnetinterface.h"
+#include "chunkcache.h"
 #include "playermanager.h"
 #include "chunkmanager.h"
 #include "netplayer.h"
 #include "debugdraw.h"
 #include "network.h"
+#include "messages.h"
 #include "block.h"
 #include "chunk.h"
 
 static Log logger{"ClientNetInterface"};
 
+// A block edit that has been applied locally but not yet acknowledged
+// Blocks are packed as blockID<<2 | orientation
+struct PendingBlockEdit {
+	u16 sequence;
+	u16 chunkID;
+	ivec3 position;
+	u16 predicted;
+	u16 authoritative; // Last state of the cell the server told us about
+};
+
+static std::vector<PendingBlockEdit> pendingEdits;
+static u16 blockEditSequence = 0;
+
+static u16 GetPackedBlock(std::shared_ptr<Chunk> ch, ivec3 pos) {
+	auto blk = ch->GetBlock(pos);
+	return blk? (blk->blockID << 2 | blk->orientation) : 0;
+}
+
+static void ApplyPackedBlock(std::shared_ptr<Chunk> ch, ivec3 pos, u16 packed) {
+	// Avoid recreating blocks, which would refire dynamic block callbacks
+	if(GetPackedBlock(ch, pos) == packed) return;
+
+	if(packed >> 2) {
+		auto blk = ch->CreateBlock(pos, packed >> 2);
+		if(blk) blk->orientation = packed & 3;
+		else logger << "Block create failed at " << pos;
+	}else{
+		ch->DestroyBlock(pos);
+	}
+}
+
+static PendingBlockEdit* FindPendingEdit(u16 chunkID, ivec3 pos) {
+	for(auto& e: pendingEdits)
+		if(e.chunkID == chunkID && e.position == pos) return &e;
+
+	return nullptr;
+}
+
 // Messages from server
 static void OnUpdatePlayerState(Packet&);
 
@@ -16,7 +56,10 @@ static void OnNewChunk(Packet&);
 static void OnRemoveChunk(Packet&);
 
 static void OnSetBlock(Packet&);
+static void OnSetBlockAck(Packet&);
+static void OnRegionEdit(Packet&);
 static void OnChunkDownload(Packet&);
+static void OnWorldInfo(Packet&);
 static void OnSetChunkNeighborhood(Packet&);
 static void OnSetNeighborhoodTransform(Packet&);
 
@@ -29,33 +72,29 @@ void ClientNetInterface::Update(std::shared_ptr<Network> net) {
 
 		switch(type) {
 			case PacketType::RemoteJoin: {
-				u16 playerID;
-				u8 joinType;
-				packet.Read(playerID);
-				packet.Read(joinType);
+				RemoteJoinMessage msg;
+				ReadMessage(packet, msg);
 
 				auto pmgr = PlayerManager::Get();
-				if(!pmgr->GetPlayer(playerID))
-					pmgr->AddPlayer(std::make_shared<NetPlayer>(), playerID);
+				if(!pmgr->GetPlayer(msg.playerID))
+					pmgr->AddPlayer(std::make_shared<NetPlayer>(), msg.playerID);
 
-				if(!joinType)
-					logger << "Player " << playerID << " joined";
+				if(!msg.reason)
+					logger << "Player " << msg.playerID << " joined";
 
 			} break;
 
 			case PacketType::RemoteLeave: {
-				u16 playerID;
-				u8 reason;
-				packet.Read(playerID);
-				packet.Read(reason);
+				RemoteLeaveMessage msg;
+				ReadMessage(packet, msg);
 
 				auto pmgr = PlayerManager::Get();
-				pmgr->RemovePlayer(playerID);
+				pmgr->RemovePlayer(msg.playerID);
 
-				if(!reason)
-					logger << "Player " << playerID << " disconnected";
+				if(!msg.reason)
+					logger << "Player " << msg.playerID << " disconnected";
 				else
-					logger << "Player " << playerID << " lost connection";
+					logger << "Player " << msg.playerID << " lost connection";
 			} break;
 
 			case PacketType::UpdatePlayerState: OnUpdatePlayerState(packet); break;
@@ -64,21 +103,26 @@ void ClientNetInterface::Update(std::shared_ptr<Network> net) {
 			case PacketType::RemoveChunk: OnRemoveChunk(packet); break;
 
 			case PacketType::SetBlock: OnSetBlock(packet); break;
+			case PacketType::SetBlockAck: OnSetBlockAck(packet); break;
+			case PacketType::RegionEdit: OnRegionEdit(packet); break;
 			case PacketType::ChunkDownload: OnChunkDownload(packet); break;
 			case PacketType::SetChunkNeighborhood: OnSetChunkNeighborhood(packet); break;
 			case PacketType::SetNeighborhoodTransform: OnSetNeighborhoodTransform(packet); break;
+			case PacketType::WorldInfo: OnWorldInfo(packet); break;
 		}
 	}
 }
 
 void ClientNetInterface::UpdatePlayerState(vec3 p, vec3 v, quat o, quat e) {
-	Packet packet;
-	packet.WriteType(PacketType::UpdatePlayerState);
+	PlayerStateMessage msg;
+	msg.position = p;
+	msg.velocity = v;
+	msg.orientation = o;
+	msg.eyeOrientation = e;
+
 	// This is a fairly large packet, optimisation warranted 
-	packet.Write(p);
-	packet.Write(v);
-	packet.Write(o);
-	packet.Write(e);
+	Packet packet;
+	WriteMessage(packet, msg);
 
 	packet.reliability = UNRELIABLE_SEQUENCED;
 	packet.priority = MEDIUM_PRIORITY;
@@ -100,31 +144,94 @@ void ClientNetInterface::SetPlayerSector(u8) {
 }
 
 void ClientNetInterface::SetBlock(u16 chunkID, ivec3 pos, u16 type, u8 orientation) {
+	u16 sequence = ++blockEditSequence;
+	u16 packed = type << 2 | (orientation & 3);
+
+	// Predict the edit. Edits outside the chunk may create new chunks 
+	//	on the server, so those wait for the server
+	auto ch = ChunkManager::Get()->GetChunk(chunkID);
+	if(ch && ch->InBounds(pos)) {
+		PendingBlockEdit edit;
+		edit.sequence = sequence;
+		edit.chunkID = chunkID;
+		edit.position = pos;
+		edit.predicted = packed;
+
+		// Earlier predictions on this cell aren't authoritative
+		auto earlier = FindPendingEdit(chunkID, pos);
+		edit.authoritative = earlier? earlier->authoritative : GetPackedBlock(ch, pos);
+
+		pendingEdits.push_back(edit);
+		ApplyPackedBlock(ch, pos, packed);
+	}
+
+	SetBlockRequest req;
+	req.chunkID = chunkID;
+	req.position = pos;
+	req.packedBlock = packed;
+	req.sequence = sequence;
+
 	Packet packet;
-	packet.WriteType(PacketType::SetBlock);
-	packet.Write(chunkID);
-	packet.Write(pos);
-	packet.Write<u16>(type << 2 | orientation);
+	WriteMessage(packet, req);
 
+	// Ordered so that the server applies edits in the order they were predicted
+	packet.reliability = RELIABLE_ORDERED;
+	packet.channel = NetChannel::ForChunk(chunkID);
 	Network::Get()->Send(packet);
 }
 
 void ClientNetInterface::DoInteract(u16 chunkID, ivec3 pos) {
+	PlayerInteractMessage msg;
+	msg.chunkID = chunkID;
+	msg.position = pos;
+
 	Packet packet;
-	packet.WriteType(PacketType::PlayerInteract);
-	packet.Write(chunkID);
-	packet.Write(pos);
+	WriteMessage(packet, msg);
 
 	Network::Get()->Send(packet);
 }
 
-void ClientNetInterface::RequestRefreshChunks() {
+// Region edits aren't predicted, since they can touch a lot of blocks
+//	and pastes need the template, which only the server has
+void ClientNetInterface::EditRegion(u16 chunkID, const RegionEdit& edit) {
+	RegionEditRequest req;
+	req.chunkID = chunkID;
+	req.edit = edit;
+
+	Packet packet;
+	WriteMessage(packet, req);
+
+	// Same channel as SetBlock so that edits to a chunk apply in the order they're made
+	packet.reliability = RELIABLE_ORDERED;
+	packet.channel = NetChannel::ForChunk(chunkID);
+	Network::Get()->Send(packet);
+}
+
+// Asks for the contents of every chunk, except those listed with a current hash
+static void SendChunkDownloadRequest(const std::vector<std::pair<u16, u64>>& hashes) {
 	Packet packet;
 	packet.WriteType(PacketType::ChunkDownload);
+	packet.Write<u16>(hashes.size());
+	for(auto& h: hashes) {
+		packet.Write<u16>(h.first);
+		packet.Write<u64>(h.second);
+	}
 
+	packet.reliability = RELIABLE_ORDERED;
+	packet.channel = NetChannel::Session;
 	Network::Get()->Send(packet);
 }
 
+void ClientNetInterface::RequestRefreshChunks() {
+	std::vector<std::pair<u16, u64>> hashes;
+	for(auto& ch: ChunkManager::Get()->chunks) {
+		if(!ch->chunkID) continue;
+		hashes.emplace_back(ch->chunkID, ch->GetBlocksHash());
+	}
+
+	SendChunkDownloadRequest(hashes);
+}
+
 /*
 	                                                                                                             
 	 ad88888ba                                                          88b           d88                        
@@ -139,91 +246,81 @@ void ClientNetInterface::RequestRefreshChunks() {
 	                                                                                                  "Y8bbdP"   
 */
 void OnUpdatePlayerState(Packet& packet) {
-	vec3 pos, vel;
-	quat ori, eye;
-	u16 playerID;
-
-	packet.Read<u16>(playerID);
-	packet.Read(pos);
-	packet.Read(vel);
-	packet.Read(ori);
-	packet.Read(eye);
+	RemotePlayerStateMessage msg;
+	ReadMessage(packet, msg);
 
 	auto pmgr = PlayerManager::Get();
-	auto player = pmgr->GetPlayer(playerID);
+	auto player = pmgr->GetPlayer(msg.playerID);
 	if(!player) return;
 
-	player->SetPosition(pos);
-	player->SetVelocity(vel);
-	player->SetOrientation(ori);
-	player->SetEyeOrientation(eye);
+	player->PushState(msg.tick, msg.position, msg.velocity, msg.orientation, msg.eyeOrientation);
 }
 
 void OnNewChunk(Packet& packet) {
 	auto chmgr = ChunkManager::Get();
-	u16 chunkID;
-	u16 neighborhoodID;
-	u8 w,h,d;
-	vec3 position;
-	quat rotation;
-	ivec3 poi;
-
-	packet.Read(chunkID);
-	packet.Read(neighborhoodID);
-	packet.Read(w);
-	packet.Read(h);
-	packet.Read(d);
+
+	NewChunkMessage msg;
+	ReadMessage(packet, msg);
+
+	u16 chunkID = msg.chunkID;
+	u16 neighborhoodID = msg.neighborhoodID;
+	u8 w = msg.width, h = msg.height, d = msg.depth;
 
 	auto ch = chmgr->CreateChunk(w,h,d);
 	ch->chunkID = chunkID;
 
 	if(!neighborhoodID) {
-		packet.Read(position);
-		packet.Read(rotation);
+		// Chunks only collide as part of a neighborhood, so lone chunks
+		//	get an unnumbered one of their own
+		auto neigh = chmgr->CreateNeighborhood();
+		neigh->position = msg.position;
+		neigh->rotation = msg.rotation;
 
-		ch->position = position;
-		ch->rotation = rotation;
+		ch->SetNeighborhood(neigh);
+		neigh->UpdateChunkTransforms();
 
 	}else{
-		packet.Read(poi);
-
+		// The neighborhood may already exist without chunks if its
+		//	transform arrived first
 		auto neigh = chmgr->GetNeighborhood(neighborhoodID);
 		if(!neigh) {
 			neigh = chmgr->CreateNeighborhood();
 			neigh->neighborhoodID = neighborhoodID;
-			neigh->chunkSize = ivec3{w,h,d};
 		}
+
+		if(neigh->chunkSize == ivec3{0})
+			neigh->chunkSize = ivec3{w,h,d};
 		
 		ch->SetNeighborhood(neigh);
-		ch->positionInNeighborhood = poi;
-		neigh->UpdateChunkTransform(ch);
+		neigh->SetChunkPosition(ch.get(), msg.positionInNeighborhood);
 	}
 
-	// logger << "New chunk " << chunkID << " at " << position;
+	// The server won't send contents for chunks whose cached copy is current
+	if(msg.cached && !ChunkCache::Get()->Restore(ch))
+		logger << "Server expected chunk " << chunkID << " to be cached, but it isn't";
+
+	// logger << "New chunk " << chunkID << " at " << msg.position;
 }
 
 void OnRemoveChunk(Packet& packet) {
 	auto chmgr = ChunkManager::Get();
 
-	u16 chunkID;
-	packet.Read(chunkID);
+	RemoveChunkMessage msg;
+	ReadMessage(packet, msg);
 
-	chmgr->DestroyChunk(chunkID);
+	chmgr->DestroyChunk(msg.chunkID);
 }
 
 void OnSetBlock(Packet& packet) {
 	auto chmgr = ChunkManager::Get();
-	u8 orientation;
-	u16 chunkID, blockType;
-	ivec3 vxPos;
 
 	// Assume vxPos is in bounds
-	packet.Read(chunkID);
-	packet.Read<ivec3>(vxPos);
-	packet.Read(blockType);
+	SetBlockMessage msg;
+	ReadMessage(packet, msg);
 
-	orientation = blockType & 3;
-	blockType >>= 2;
+	u16 chunkID = msg.chunkID;
+	u16 packed = msg.packedBlock;
+	ivec3 vxPos = msg.position;
 
 	auto ch = chmgr->GetChunk(chunkID);
 	if(!ch) {
@@ -231,13 +328,71 @@ void OnSetBlock(Packet& packet) {
 		return;
 	}
 
-	if(blockType) {
-		auto blk = ch->CreateBlock(vxPos, blockType);
-		if(blk) blk->orientation = orientation;
-		else logger << "Block create failed at " << vxPos;
-	}else{
-		ch->DestroyBlock(vxPos);
+	// While edits to this cell are in flight, our prediction stays visible.
+	//	Remember the server's state in case they get rejected
+	bool predicted = false;
+	for(auto& e: pendingEdits) {
+		if(e.chunkID != chunkID || e.position != vxPos) continue;
+		e.authoritative = packed;
+		predicted = true;
+	}
+
+	if(!predicted) ApplyPackedBlock(ch, vxPos, packed);
+}
+
+void OnRegionEdit(Packet& packet) {
+	RegionEditMessage msg;
+	ReadMessage(packet, msg);
+
+	auto ch = ChunkManager::Get()->GetChunk(msg.chunkID);
+	if(!ch) {
+		logger << "Missing chunkID " << msg.chunkID;
+		return;
 	}
+
+	// The server hasn't seen edits still in flight yet, so the edit is applied
+	//	to the server's state of their cells. A Replace mustn't match a block
+	//	that only exists as our prediction
+	for(auto& e: pendingEdits)
+		if(e.chunkID == msg.chunkID) ApplyPackedBlock(ch, e.position, e.authoritative);
+
+	ApplyRegionEdit(ch.get(), msg.edit, &msg.pasted);
+
+	// The result becomes their authoritative state and the predictions are restored
+	for(auto& e: pendingEdits)
+		if(e.chunkID == msg.chunkID) e.authoritative = GetPackedBlock(ch, e.position);
+
+	for(auto& e: pendingEdits)
+		if(e.chunkID == msg.chunkID) ApplyPackedBlock(ch, e.position, e.predicted);
+}
+
+void OnSetBlockAck(Packet& packet) {
+	SetBlockAckMessage msg;
+	ReadMessage(packet, msg);
+
+	u16 sequence = msg.sequence;
+	bool accepted = msg.accepted;
+
+	auto it = std::find_if(pendingEdits.begin(), pendingEdits.end(), [sequence](const PendingBlockEdit& e) {
+		return e.sequence == sequence;
+	});
+
+	// Edits that weren't predicted have nothing to reconcile
+	if(it == pendingEdits.end()) return;
+
+	auto edit = *it;
+	pendingEdits.erase(it);
+
+	if(!accepted)
+		logger << "Block edit " << sequence << " rejected at " << edit.position;
+
+	// Newer predictions on this cell are resolved by their own acks
+	if(FindPendingEdit(edit.chunkID, edit.position)) return;
+
+	// The server's SetBlock for this edit has already arrived, so whether it was 
+	//	accepted, rejected or altered, the cell should match the authoritative state
+	if(auto ch = ChunkManager::Get()->GetChunk(edit.chunkID))
+		ApplyPackedBlock(ch, edit.position, edit.authoritative);
 }
 
 void OnChunkDownload(Packet& p) {
@@ -255,39 +410,22 @@ void OnChunkDownload(Packet& p) {
 		return;
 	}
 
-	u8 w = ch->width;
-	u8 h = ch->height;
-	u8 d = ch->depth;
-
-	u8 x, y, z;
-	z = offset % d;
-	y = (offset / d) % h;
-	x = (offset / d / h) % w;
+	// Payload is a span of packed blocks in storage order,
+	//	which SetSpan writes straight into the chunk
+	static std::vector<u16> packedBlocks;
+	packedBlocks.resize(size);
+	for(u8 i = 0; i < size; i++)
+		p.Read(packedBlocks[i]);
 
-	for(u8 i = 0; i < size; i++) {
-		u16 blockType;
-		p.Read(blockType);
-
-		u8 orientation = blockType&3;
-		blockType >>= 2;
-
-		auto blk = ch->CreateBlock(ivec3{x,y,z}, blockType);
-		if(blk) blk->orientation = orientation;
-
-		if(++z >= d) {
-			if(++y >= h) {
-				++x; 
-				y = 0;
-			}
-			z = 0;
-		}
-	}
+	ch->SetSpan(offset, size, packedBlocks.data());
 }
 
 void OnSetChunkNeighborhood(Packet& packet) {
-	u16 chunkID, neighborhoodID;
-	packet.Read(chunkID);
-	packet.Read(neighborhoodID);
+	SetChunkNeighborhoodMessage msg;
+	ReadMessage(packet, msg);
+
+	u16 chunkID = msg.chunkID;
+	u16 neighborhoodID = msg.neighborhoodID;
 
 	auto chmgr = ChunkManager::Get();
 	auto ch = chmgr->GetChunk(chunkID);
@@ -300,34 +438,51 @@ void OnSetChunkNeighborhood(Packet& packet) {
 	if(!neigh) {
 		neigh = chmgr->CreateNeighborhood();
 		neigh->neighborhoodID = neighborhoodID;
-		neigh->chunkSize = ivec3{ch->width, ch->height, ch->depth};
 	}
 
+	if(neigh->chunkSize == ivec3{0})
+		neigh->chunkSize = ivec3{ch->width, ch->height, ch->depth};
+
 	ch->SetNeighborhood(neigh);
-	packet.Read<ivec3>(ch->positionInNeighborhood);
+	neigh->SetChunkPosition(ch.get(), msg.positionInNeighborhood);
 
 	logger << ch->positionInNeighborhood;
-	neigh->UpdateChunkTransform(ch);
 }
 
 void OnSetNeighborhoodTransform(Packet& packet) {
-	u16 neighID;
-	vec3 pos;
-	quat rot;
+	NeighborhoodTransformMessage msg;
+	ReadMessage(packet, msg);
 
-	packet.Read(neighID);
-	packet.Read(pos);
-	packet.Read(rot);
+	u16 neighID = msg.neighborhoodID;
 
 	auto chmgr = ChunkManager::Get();
+	// Transforms travel on their own channel, so they can arrive before
+	//	the first chunk of the neighborhood
 	auto neigh = chmgr->GetNeighborhood(neighID);
 	if(!neigh) {
-		logger << "Server tried to update transform of non-existent neighborhood";
-		return;
+		neigh = chmgr->CreateNeighborhood();
+		neigh->neighborhoodID = neighID;
 	}
 
-	neigh->position = pos;
-	neigh->rotation = rot;
+	// Extrapolated every frame until the next correction
+	neigh->position = msg.position;
+	neigh->rotation = msg.rotation;
+	neigh->velocity = msg.velocity;
+	neigh->angularVelocity = msg.angularVelocity;
+	neigh->pivot = msg.pivot;
 	neigh->UpdateChunkTransforms();
 }
 
+void OnWorldInfo(Packet& packet) {
+	WorldInfoMessage msg;
+	ReadMessage(packet, msg);
+
+	auto cache = ChunkCache::Get();
+	cache->SetWorld(msg.worldID);
+
+	std::vector<std::pair<u16, u64>> hashes;
+	for(auto& kv: cache->entries)
+		hashes.emplace_back(kv.first, kv.second.hash);
+
+	SendChunkDownloadRequest(hashes);
+}
@@ -1,6 +1,7 @@
 #include "clientnetinterface.h"
 #include "chunkmanager.h"
 #include "localplayer.h"
+#include "regionedit.h"
 #include "camera.h"
 #include "chunk.h"
 #include "input.h"
@@ -9,18 +10,22 @@
 static Log logger{"LocalPlayer"};
 
 // TODO: This needs to take player orientation into account
+// Body transforms are relative to whichever physics space the body is in
 struct PlayerMotionState : public btMotionState {
 	Camera* cam;
+	RigidBody* body = nullptr;
 	vec3 cameraOffset {0, PlayerBase::PlayerHeight/2.f, 0};
 
 	PlayerMotionState(Camera* c) : cam{c} {}
 
 	void getWorldTransform(btTransform& worldTrans) const override {
+		auto space = Physics::GetBodySpace(body);
 		worldTrans.setIdentity();
-		worldTrans.setOrigin(o2bt(cam->position - cameraOffset));
+		worldTrans.setOrigin(o2bt(space->ToLocal(cam->position - cameraOffset)));
 	}
 	void setWorldTransform(const btTransform& newTrans) override {
-		auto pos = bt2o(newTrans.getOrigin());
+		auto space = Physics::GetBodySpace(body);
+		auto pos = space->ToWorld(bt2o(newTrans.getOrigin()));
 		cam->position = pos + cameraOffset;
 	}
 };
@@ -35,6 +40,7 @@ LocalPlayer::LocalPlayer(std::shared_ptr<Camera> c): camera{c}, noclip{false} {
 
 	RigidBodyInfo bodyInfo{mass, ms, collider, inertia};
 	rigidbody = new RigidBody{bodyInfo};
+	ms->body = rigidbody;
 	Physics::world->addRigidBody(rigidbody);
 	
 	rigidbody->setAngularFactor(0.f);
@@ -62,7 +68,10 @@ void LocalPlayer::Update() {
 		Input::GetMapped(Input::Backward) - Input::GetMapped(Input::Forward), 0
 	};
 
-	vec3 prevVelocity = bt2o(rigidbody->getLinearVelocity());
+	// Step aboard or off of neighborhoods. Velocities are in the space's frame
+	auto space = Physics::UpdateBodySpace(rigidbody);
+
+	vec3 prevVelocity = space->ToWorldDir(bt2o(rigidbody->getLinearVelocity()));
 	vec3 velocity {0.f};
 	quat forwardRot {1,0,0,0};
 	if(noclip){
@@ -87,7 +96,7 @@ void LocalPlayer::Update() {
 		if(Input::GetMappedDown(Input::Jump))
 			velocity.y += 10.f;
 
-		rigidbody->setLinearVelocity(o2bt(velocity));
+		rigidbody->setLinearVelocity(o2bt(space->ToLocalDir(velocity)));
 	}
 	
 	// TODO: Limit send rate - probably doesn't need to be sent every 16ms
@@ -112,16 +121,20 @@ void LocalPlayer::Update() {
 	if(Input::GetKeyDown('[')) blockRot = (blockRot-1)&3;
 	if(Input::GetKeyDown(']')) blockRot = (blockRot+1)&3;
 
+	UpdateRegionTool();
+
 	if(Input::GetButtonDown(Input::MouseLeft) || Input::GetButtonDown(Input::MouseRight)) {
 		auto raycastResult = Physics::Raycast(
 			camera->position + camera->forward*0.3f,
 			camera->position + camera->forward*10.f);
 
 		if(raycastResult.hit){
-			auto col = raycastResult.rigidbody->getCollisionShape();
 			// TODO: Change this
 			// It will explode as soon as we start using the user pointers for other things
-			if(auto chnk = (Chunk*)col->getUserPointer()) {
+			auto neigh = (ChunkNeighborhood*)raycastResult.rigidbody->getUserPointer();
+			auto chnk = neigh? neigh->GetChunkContaining(raycastResult.position - raycastResult.normal*0.1f) : nullptr;
+
+			if(chnk) {
 				auto normal = raycastResult.normal;
 
 				if(Input::GetButtonDown(Input::MouseRight) || !blockType)
@@ -167,7 +180,7 @@ void LocalPlayer::Update() {
 				}
 
 			}else{
-				logger << col;
+				logger << raycastResult.rigidbody->getCollisionShape();
 			}
 		}
 	}
@@ -176,7 +189,8 @@ void LocalPlayer::Update() {
 void LocalPlayer::SetNoclip(bool n) {
 	noclip = n;
 
-	Physics::world->removeRigidBody(rigidbody);
+	auto world = Physics::GetBodySpace(rigidbody)->world;
+	world->removeRigidBody(rigidbody);
 
 	auto flags = rigidbody->getCollisionFlags();
 	if(noclip){
@@ -186,6 +200,92 @@ void LocalPlayer::SetNoclip(bool n) {
 	}
 	rigidbody->setCollisionFlags(flags);
 
-	Physics::world->addRigidBody(rigidbody);
+	world->addRigidBody(rigidbody);
 }
 
+// v marks a corner of the region at the targeted block, then
+//	f fills it, h makes it a hollow box, x replaces the type at the
+//	first corner, c copies it to the clipboard and p pastes at the targeted block
+void LocalPlayer::UpdateRegionTool() {
+	u8 op = RegionOp::Count;
+	if(Input::GetKeyDown(SDLK_f)) op = RegionOp::Fill;
+	if(Input::GetKeyDown(SDLK_h)) op = RegionOp::Hollow;
+	if(Input::GetKeyDown(SDLK_x)) op = RegionOp::Replace;
+	if(Input::GetKeyDown(SDLK_c)) op = RegionOp::Copy;
+	if(Input::GetKeyDown(SDLK_p)) op = RegionOp::Paste;
+
+	bool mark = Input::GetKeyDown(SDLK_v);
+	if(!mark && op != RegionOp::Paste) {
+		if(op == RegionOp::Count) return;
+		if(regionCornerCount < 2) {
+			logger << "Mark two corners with v first";
+			return;
+		}
+	}
+
+	// Corners and pastes are placed at the targeted block
+	std::shared_ptr<Chunk> target;
+	ivec3 targetPos;
+	if(mark || op == RegionOp::Paste) {
+		auto raycastResult = Physics::Raycast(
+			camera->position + camera->forward*0.3f,
+			camera->position + camera->forward*10.f);
+
+		if(!raycastResult.hit) return;
+
+		auto neigh = (ChunkNeighborhood*)raycastResult.rigidbody->getUserPointer();
+		target = neigh? neigh->GetChunkContaining(raycastResult.position - raycastResult.normal*0.1f) : nullptr;
+		if(!target) return;
+
+		targetPos = target->WorldToVoxelSpace(raycastResult.position - raycastResult.normal*0.1f);
+	}
+
+	if(mark) {
+		if(regionCornerCount >= 2) regionCornerCount = 0;
+		regionCorners[regionCornerCount++] = RegionCorner{target, targetPos};
+		logger << "Region corner " << (u32)regionCornerCount << " at " << targetPos;
+		return;
+	}
+
+	RegionEdit edit;
+	edit.op = op;
+	edit.packedBlock = blockType << 2 | (blockRot & 3);
+	edit.replaceID = 0;
+	edit.templateID = 0;
+
+	if(op == RegionOp::Paste) {
+		edit.min = edit.max = targetPos;
+		ClientNetInterface::EditRegion(target->chunkID, edit);
+		return;
+	}
+
+	auto chunkA = regionCorners[0].chunk.lock();
+	auto chunkB = regionCorners[1].chunk.lock();
+	if(!chunkA || !chunkB) {
+		regionCornerCount = 0;
+		return;
+	}
+
+	// Edits are sent in the first corner's chunk space
+	ivec3 posA = regionCorners[0].position;
+	ivec3 posB = regionCorners[1].position;
+	if(chunkA != chunkB) {
+		if(chunkA->neighborhood.lock() != chunkB->neighborhood.lock()) {
+			logger << "Region corners must be in the same neighborhood";
+			return;
+		}
+
+		ivec3 chunkSize {chunkA->width, chunkA->height, chunkA->depth};
+		posB += (chunkB->positionInNeighborhood - chunkA->positionInNeighborhood) * chunkSize;
+	}
+
+	edit.min = glm::min(posA, posB);
+	edit.max = glm::max(posA, posB) + 1;
+
+	if(op == RegionOp::Replace) {
+		auto blk = chunkA->GetBlock(regionCorners[0].position);
+		edit.replaceID = blk? blk->blockID : 0;
+	}
+
+	ClientNetInterface::EditRegion(chunkA->chunkID, edit);
+}
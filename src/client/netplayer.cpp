@@ -1,19 +1,64 @@
 #include "netplayer.h"
 #include "debugdraw.h"
 
-NetPlayer::NetPlayer() : realPosition{0.f}, position{0.f}, velocity{0.f} {}
+f32 NetPlayer::interpolationDelay = 0.15f;
+
+NetPlayer::NetPlayer() : firstSnapshot{0}, numSnapshots{0}, renderTick{0.0}, serverTick{0.0}, 
+	orientation{1,0,0,0}, eyeOrientation{1,0,0,0}, position{0.f}, velocity{0.f} {}
 
 void NetPlayer::Update() {
-	// Basic interpolation
-	position = glm::mix(
-		position, 
-		realPosition + velocity * timeSinceUpdate * .5f, 
-		Time::dt * 10.f + timeSinceUpdate);
+	if(!numSnapshots) return;
+
+	f64 ticksPerSecond = 1.0 / Network::TickInterval;
+	f64 dtTicks = Time::dt * ticksPerSecond;
+	serverTick += dtTicks;
 
-	eyeOrientation = glm::mix(eyeOrientation, realEyeOri, Time::dt * 5.f);
-	orientation = glm::mix(orientation, realOri, Time::dt * 5.f);
+	// Advance at real time, drifting towards the target to absorb jitter.
+	//	Large errors mean a stall or a clock jump, so snap
+	f64 target = serverTick - interpolationDelay * ticksPerSecond;
+	f64 error = target - (renderTick + dtTicks);
 
-	timeSinceUpdate += Time::dt;
+	if(std::abs(error) > ticksPerSecond) renderTick = target;
+	else renderTick += dtTicks + error * std::min(1.0, Time::dt * 2.0);
+
+	Sample(renderTick);
+}
+
+void NetPlayer::Sample(f64 tick) {
+	auto& oldest = GetSnapshot(0);
+	auto& newest = GetSnapshot(numSnapshots-1);
+
+	if(tick <= oldest.tick) {
+		position = oldest.position;
+		velocity = oldest.velocity;
+		orientation = oldest.orientation;
+		eyeOrientation = oldest.eyeOrientation;
+		return;
+	}
+
+	// Past the newest snapshot, so dead reckon for a bounded time
+	if(tick >= newest.tick) {
+		f32 ahead = std::min<f32>((tick - newest.tick) * Network::TickInterval, MaxExtrapolation);
+
+		position = newest.position + newest.velocity * ahead;
+		velocity = newest.velocity;
+		orientation = newest.orientation;
+		eyeOrientation = newest.eyeOrientation;
+		return;
+	}
+
+	// Find the pair of snapshots surrounding tick
+	u32 i = numSnapshots-1;
+	while(i > 0 && GetSnapshot(i-1).tick > tick) i--;
+
+	auto& a = GetSnapshot(i-1);
+	auto& b = GetSnapshot(i);
+	f32 t = (tick - a.tick) / (f64)(b.tick - a.tick);
+
+	position = glm::mix(a.position, b.position, t);
+	velocity = glm::mix(a.velocity, b.velocity, t);
+	orientation = glm::slerp(a.orientation, b.orientation, t);
+	eyeOrientation = glm::slerp(a.eyeOrientation, b.eyeOrientation, t);
 }
 
 void NetPlayer::Render() {
@@ -25,21 +70,40 @@ void NetPlayer::Render() {
 	Debug::Line(eye, eye + vec3{0,0,-1} * eyeOrientation, vec3{0,0,1});
 }
 
-void NetPlayer::SetPosition(vec3 p) {
-	timeSinceUpdate = 0.f;
-	realPosition = p;
-}
+void NetPlayer::PushState(u32 tick, vec3 pos, vec3 vel, quat ori, quat eyeOri) {
+	// Updates are sequenced, so a tick at or before the newest is either a
+	//	duplicate, which is dropped, or from a restarted server. Ticks from
+	//	before everything buffered can only be the latter, so start over
+	if(numSnapshots) {
+		u32 newest = GetSnapshot(numSnapshots-1).tick;
+		u32 oldest = GetSnapshot(0).tick;
 
-void NetPlayer::SetVelocity(vec3 v) {
-	velocity = v;
-}
+		if(tick <= newest) {
+			if(newest - tick <= newest - oldest) return;
+			numSnapshots = 0;
+		}
+	}
 
-void NetPlayer::SetOrientation(quat o) {
-	realOri = o;
-}
+	if(numSnapshots == SnapshotCount) {
+		firstSnapshot = (firstSnapshot+1) % SnapshotCount;
+		numSnapshots--;
+	}
+
+	auto& s = GetSnapshot(numSnapshots++);
+	s.tick = tick;
+	s.position = pos;
+	s.velocity = vel;
+	s.orientation = ori;
+	s.eyeOrientation = eyeOri;
 
-void NetPlayer::SetEyeOrientation(quat o) {
-	realEyeOri = o;
+	// The newest snapshot was sent just now as far as we know. Latency is
+	//	constant enough that this makes a fine estimate of the server clock
+	if(numSnapshots == 1 || std::abs(tick - serverTick) > 1.0 / Network::TickInterval) {
+		serverTick = tick;
+		renderTick = tick - interpolationDelay / Network::TickInterval;
+	}else{
+		serverTick = std::max<f64>(serverTick, tick);
+	}
 }
 
 vec3 NetPlayer::GetEyePosition() {
@@ -76,3 +76,24 @@ void QuadElementBuffer::Draw(u64 numQuads) {
 	glDrawElements(GL_TRIANGLES, numQuads*6, elementType, nullptr);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
+
+void QuadElementBuffer::MultiDraw(u64 maxQuads, const s32* counts, const s32* baseVertices, u32 drawCount) {
+	if(!drawCount) return;
+
+	// Every draw indexes from the start of the element buffer
+	static std::vector<const void*> offsets;
+	offsets.resize(drawCount, nullptr);
+
+	SetNumQuads(maxQuads);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, elementType, (const void**)&offsets[0], drawCount, baseVertices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+
+void QuadElementBuffer::DrawInstanced(u64 numQuads, s32 baseVertex, u32 instanceCount) {
+	SetNumQuads(numQuads);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, numQuads*6, elementType, nullptr, instanceCount, baseVertex);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include "chunkstream.h"
+#include "chunkmanager.h"
+#include "chunk.h"
+
+#include <algorithm>
+
+ChunkStream::ChunkStream() : hashesReceived{false}, focus{0.f}, byteCredit{0}, needsSort{false} {}
+
+void ChunkStream::Queue(u16 chunkID) {
+	if(std::find(pending.begin(), pending.end(), chunkID) != pending.end()) return;
+
+	pending.push_back(chunkID);
+	needsSort = true;
+}
+
+void ChunkStream::QueueAll(ChunkManager* chunkManager) {
+	for(auto& chunk: chunkManager->chunks) {
+		if(!chunk->chunkID) continue;
+		Queue(chunk->chunkID);
+	}
+}
+
+void ChunkStream::UpdateFocus(vec3 position, ChunkManager* chunkManager) {
+	if(glm::length(position - focus) > ReprioritizeDistance) {
+		focus = position;
+		needsSort = true;
+	}
+
+	if(!needsSort || pending.empty()) return;
+	needsSort = false;
+
+	std::map<u16, f32> distances;
+	for(auto& chunk: chunkManager->chunks) {
+		auto center = chunk->VoxelToWorldSpace(ivec3{chunk->width, chunk->height, chunk->depth}/2);
+		distances[chunk->chunkID] = glm::length(center - focus);
+	}
+
+	// Chunks that no longer exist sort nearest and get dropped when popped
+	std::sort(pending.begin(), pending.end(), [&distances](u16 a, u16 b) {
+		return distances[a] > distances[b];
+	});
+}
+
+bool ChunkStream::HasPending() const {
+	return !pending.empty();
+}
+
+u16 ChunkStream::PopNearest() {
+	u16 chunkID = pending.back();
+	pending.pop_back();
+	return chunkID;
+}
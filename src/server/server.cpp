@@ -1,12 +1,16 @@
+#include "blockscheduler.h"
 #include "chunk.h"
 #include "block.h"
 #include "server.h"
 #include "network.h"
+#include "messages.h"
+#include "serverphysics.h"
 #include "serverplayer.h"
 #include "chunkmanager.h"
 #include "playermanager.h"
 
 #include <chrono>
+#include <random>
 #include <thread>
 
 static Log logger{"Server"};
@@ -16,16 +20,23 @@ using namespace std::chrono;
 void Server::Run() {
 	Log::SetLogFile("server.out");
 	BlockRegistry::InitBlockInfo();
+	Physics::Init();
 
 	network = Network::Get();
 	network->Init();
 	network->Host(16660, 10);
 
+	// Everything sent during a tick goes out together at the end of it
+	network->coalesce = true;
+
 	chunkManager = ChunkManager::Get();
 	playerManager = PlayerManager::Get();
+	blockScheduler = BlockScheduler::Get();
 	neighborhoodIDCount = 0;
 	playerIDCount = 0;
 	chunkIDCount = 0;
+	tick = 0;
+	worldID = std::random_device{}() | (u64)std::random_device{}() << 32;
 
 	// TEMPORARY
 	// Initial chunk creation should be done on game begin,
@@ -36,98 +47,123 @@ void Server::Run() {
 	startPlaneNeigh->position = vec3{0, -24.f, 0};
 	startPlaneNeigh->rotation = quat{1, 0, 0, 0};
 
+	auto steelID = BlockRegistry::GetBlockIDByName("steel");
+	auto lightID = BlockRegistry::GetBlockIDByName("lightthing");
+
 	for(s32 cx = -startPlaneSize; cx <= startPlaneSize; cx++)
 	for(s32 cz = -startPlaneSize; cz <= startPlaneSize; cz++){
 		auto chunk = chunkManager->CreateChunk(24,24,24);
 		chunk->SetNeighborhood(startPlaneNeigh);
-		chunk->positionInNeighborhood = ivec3{cx, cz, 0};
+		startPlaneNeigh->SetChunkPosition(chunk.get(), ivec3{cx, cz, 0});
 		chunk->chunkID = ++chunkIDCount;
 
-		for(u32 y = 0; y < chunk->height; y++)
-		for(u32 x = 0; x < chunk->width; x++)
-			chunk->CreateBlock(ivec3{x,y,0}, "steel");
-
-		for(u32 z = 1; z < chunk->depth; z++)
-			chunk->CreateBlock(ivec3{12,12,z}, "lightthing");
+		chunk->FillRegion(ivec3{0,0,0}, ivec3{chunk->width, chunk->height, 1}, steelID);
+		chunk->FillRegion(ivec3{12,12,1}, ivec3{13,13,chunk->depth}, lightID);
 	}
 	startPlaneNeigh->UpdateChunkTransforms();
 
 	auto mNeigh = chunkManager->CreateNeighborhood();
 	mNeigh->neighborhoodID = ++neighborhoodIDCount;
-	mNeigh->position = vec3{0, 0, 0};
-	mNeigh->rotation = glm::angleAxis<f32>(PI/4.f, vec3{0, 1, 0});
+	// Spin about the center of the chunk
+	mNeigh->pivot = vec3{2.5, 2.5,-2.5};
+	mNeigh->position = vec3{0, -10, -20} - mNeigh->pivot;
+	mNeigh->angularVelocity = glm::normalize(vec3{1,0,1}) * (0.01f / Network::TickInterval);
 	{	auto chunk = chunkManager->CreateChunk(3,3,3);
 		chunk->SetNeighborhood(mNeigh);
 		chunk->chunkID = ++chunkIDCount;
 
-		for(u8 x = 0; x < 3; x++)
-		for(u8 y = 0; y < 3; y++)
-		for(u8 z = 0; z < 3; z++)
-			chunk->CreateBlock(ivec3{x,y,z}, "lightthing");
+		chunk->FillRegion(ivec3{0,0,0}, ivec3{3,3,3}, lightID);
 	}
 	// TEMPORARY
+
+	// Main thread and physics thread each get a core, workers get the rest
+	physics = std::make_shared<ServerPhysics>();
+	physics->Start(std::max<s32>((s32)std::thread::hardware_concurrency() - 2, 0));
 	
 	logger << "Init";
 
+	auto tickDuration = duration_cast<steady_clock::duration>(duration<f32>{Network::TickInterval});
+	auto nextTick = steady_clock::now();
+
 	Packet packet;
 	while(true) {
+		tick++;
 		network->Update();
 
+		// Anything that touches chunks or neighborhoods waits for the current
+		//	physics step. Replication below reads published state instead
+		std::unique_lock<std::mutex> worldLock{physics->worldMutex};
+
 		// TODO: Instead of dispatching player/block updates as they come in,
 		//	update only on serverside, then send out state updates at regular interval
 		// This NEEDS to happen at some point
 		// High-frequency updates should only be sent to players in range
-		// Neighborhood transform updates need to be sent automatically
 
 		while(network->GetPacket(&packet)) {
 			u8 type = packet.ReadType();
 
 			switch(type) {
-			case ID_NEW_INCOMING_CONNECTION: OnPlayerConnect(packet.guid); break;
-			case ID_DISCONNECTION_NOTIFICATION: OnPlayerDisonnect(packet.guid); break;
-			case ID_CONNECTION_LOST: OnPlayerLostConnection(packet.guid); break;
-
-			case PacketType::UpdatePlayerState: OnPlayerStateUpdate(packet); break;
-			case PacketType::SetBlock: OnSetBlock(packet); break;
-			case PacketType::PlayerInteract: OnInteract(packet); break;
-			case PacketType::ChunkDownload:
-				for(auto& chunk: chunkManager->chunks){
-					SendChunkContents(chunk, packet.guid);
-				}
-				break;
+			case ID_NEW_INCOMING_CONNECTION: OnPlayerConnect(packet.guid); continue;
+			case ID_DISCONNECTION_NOTIFICATION: OnPlayerDisonnect(packet.guid); continue;
+			case ID_CONNECTION_LOST: OnPlayerLostConnection(packet.guid); continue;
+			}
+
+			// Everything else needs a session, so packets from
+			//	connections that never finished joining are dropped here
+			auto session = sessions.Find(packet.guid);
+			if(!session) continue;
+
+			session->Receive(packet, tick);
+
+			switch(type) {
+			case PacketType::UpdatePlayerState: OnPlayerStateUpdate(*session, packet); break;
+			case PacketType::SetBlock: OnSetBlock(*session, packet); break;
+			case PacketType::PlayerInteract: OnInteract(*session, packet); break;
+			case PacketType::ChunkDownload: OnChunkDownloadRequest(*session, packet); break;
+			case PacketType::RegionEdit: OnRegionEdit(*session, packet); break;
 			}
 		}
 
+		for(auto& session: sessions)
+			session->Update(Network::TickInterval);
+
 		playerManager->Update();
+		blockScheduler->Tick();
+		chunkManager->Update();
+		chunkManager->UpdateNeighborhoodMotion(Network::TickInterval);
+		physics->worldTick = tick;
+
+		worldLock.unlock();
 
 		// Send state updates for all players
 		// TODO: Limit sending packets to within a sector
 		for(auto ply: playerManager->players) {
+			if(tick % PlayerStateInterval) continue;
+
+			RemotePlayerStateMessage msg;
+			msg.playerID = ply->playerID;
+			msg.tick = tick;
+			msg.position = ply->GetPosition();
+			msg.velocity = ply->GetVelocity();
+			msg.orientation = ply->GetOrientation();
+			msg.eyeOrientation = ply->GetEyeOrientation();
+
 			packet.Reset();
-			packet.WriteType(PacketType::UpdatePlayerState);
-			packet.Write<u16>(ply->playerID);
-			packet.Write(ply->GetPosition());
-			packet.Write(ply->GetVelocity());
-			packet.Write(ply->GetOrientation());
-			packet.Write(ply->GetEyeOrientation());
+			WriteMessage(packet, msg);
 
 			packet.reliability = UNRELIABLE_SEQUENCED;
 			packet.priority = LOW_PRIORITY;
 			network->Broadcast(packet, ply->GetGUID());
 		}
 
-		// TEMPORARY
-		static f32 t = 0;
-		mNeigh->rotation = glm::angleAxis<f32>((t += 0.01f), glm::normalize(vec3{1,0,1}));
-
-		// Move rotation origin to center of chunk
-		mNeigh->position = vec3{0, -10, -20} + mNeigh->rotation * -vec3{2.5, 2.5,-2.5};
-		mNeigh->UpdateChunkTransforms();
+		UpdateNeighborhoodReplication();
+		UpdateChunkStreams();
 
-		SendNeighborhoodTransform(mNeigh);
-		// TEMPORARY
+		network->Flush();
 
-		std::this_thread::sleep_for(milliseconds{50});
+		// Ticks are stamped on state updates, so keep them evenly spaced
+		nextTick += tickDuration;
+		std::this_thread::sleep_until(nextTick);
 	}
 }
 
@@ -135,130 +171,183 @@ void Server::Run() {
 #include <raknet/RakPeerInterface.h>
 
 void Server::OnPlayerConnect(NetworkGUID guid) {
+	if(sessions.Find(guid)) return;
+
 	u16 playerID = ++playerIDCount;
-	guidToPlayerID[guid] = playerID;
 	auto player = std::make_shared<ServerPlayer>();
 	player->guid = guid;
 
 	playerManager->AddPlayer(player, playerID);
 
+	auto session = sessions.Open(guid);
+	session->playerID = playerID;
+	session->player = player;
+	session->connectTick = tick;
+	session->lastReceiveTick = tick;
+
 	auto sa = network->peer->GetSystemAddressFromGuid(guid);
 	logger << "Client " << playerID << " connected [" << sa.ToString() << "]";
 
 	// Notify players of a new player
+	RemoteJoinMessage join;
+	join.playerID = playerID;
+	join.reason = 0;
+
 	Packet packet;
-	packet.WriteType(PacketType::RemoteJoin);
-	packet.Write(playerID);
-	packet.Write<u8>(0);
+	WriteMessage(packet, join);
 	network->Broadcast(packet, guid);
 
 	// Inform new player of existing players
 	for(auto& ply: playerManager->players) {
 		if(ply->playerID == playerID) continue;
 
+		join.playerID = ply->playerID;
+		join.reason = 1;
+
 		packet.Reset();
-		packet.WriteType(PacketType::RemoteJoin);
-		packet.Write(ply->playerID);
-		packet.Write<u8>(1);
-		network->Send(packet, guid);
+		WriteMessage(packet, join);
+		Send(*session, packet);
 	}
 
-	// Inform player of what chunks exist
-	// TODO: Limit this to sector/range; be smarter
-	for(auto& chunk: chunkManager->chunks) {
-		SendNewChunk(chunk, guid);
-	}
+	// Chunks are streamed in nearest first over the next few ticks,
+	//	once the client has replied with what it has cached
+	// TODO: Limit this to sector/range
+	session->chunkStream.QueueAll(chunkManager.get());
+
+	WorldInfoMessage info;
+	info.worldID = worldID;
+
+	packet.Reset();
+	WriteMessage(packet, info);
+	packet.reliability = RELIABLE_ORDERED;
+	Send(*session, packet);
+}
 
-	// Notify player of actual neighborhood transforms
-	for(auto& neigh: chunkManager->neighborhoods){
-		SendNeighborhoodTransform(neigh, guid);
+void Server::Send(Session& session, const Packet& packet) {
+	session.Sent(packet);
+	network->Send(packet, session.guid);
+}
+
+void Server::Send(const Packet& packet, NetworkGUID guid) {
+	if(guid != RakNet::UNASSIGNED_RAKNET_GUID) {
+		if(auto session = sessions.Find(guid)) {
+			Send(*session, packet);
+			return;
+		}
 	}
 
-	// Send the contents of the just sent chunks to player
-	// TODO: Same as before, be smarter
-	// NOTE: If a ChunkDownload packet arrives before its corresponding
-	//	NewChunk packet, it will be discarded on the client side
-	for(auto& chunk: chunkManager->chunks){
-		SendChunkContents(chunk, guid);
+	network->Send(packet, guid);
+}
+
+void Server::OnChunkDownloadRequest(Session& session, Packet& packet) {
+	auto& stream = session.chunkStream;
+
+	u16 count;
+	packet.Read(count);
+	for(u16 i = 0; i < count; i++) {
+		u16 chunkID;
+		u64 hash;
+		packet.Read(chunkID);
+		packet.Read(hash);
+		stream.clientHashes[chunkID] = hash;
 	}
+
+	stream.hashesReceived = true;
+	stream.QueueAll(chunkManager.get());
 }
 
 void Server::OnPlayerDisonnect(NetworkGUID guid) {
-	// playerID 0 is invalid
-	auto playerID = guidToPlayerID[guid];
-	if(!playerID) return;
+	auto session = sessions.Find(guid);
+	if(!session) return;
 
+	auto playerID = session->playerID;
 	playerManager->RemovePlayer(playerID);
+	sessions.Close(guid);
 
 	// Inform players of player disconnect
+	RemoteLeaveMessage leave;
+	leave.playerID = playerID;
+	leave.reason = 0;
+
 	Packet packet;
-	packet.WriteType(PacketType::RemoteLeave);
-	packet.Write(playerID);
-	packet.Write<u8>(0);
+	WriteMessage(packet, leave);
 	network->Broadcast(packet, guid);
 
 	logger << "Client " << playerID << " disconnected";
 }
 
 void Server::OnPlayerLostConnection(NetworkGUID guid) {
-	// playerID 0 is invalid
-	auto playerID = guidToPlayerID[guid];
-	if(!playerID) return;
+	auto session = sessions.Find(guid);
+	if(!session) return;
 
+	auto playerID = session->playerID;
 	playerManager->RemovePlayer(playerID);
+	sessions.Close(guid);
 
 	// Inform players of player disconnect
+	RemoteLeaveMessage leave;
+	leave.playerID = playerID;
+	leave.reason = 1;
+
 	Packet packet;
-	packet.WriteType(PacketType::RemoteLeave);
-	packet.Write(playerID);
-	packet.Write<u8>(1);
+	WriteMessage(packet, leave);
 
 	logger << "Client " << playerID << " lost connection";
 }
 
-void Server::OnPlayerStateUpdate(Packet& p) {
-	auto playerID = guidToPlayerID[p.guid];
-	if(!playerID) return;
-
-	auto player = playerManager->GetPlayer(playerID);
-	if(!player) return;
-
-	vec3 pos, vel;
-	quat ori, eyeOri;
+void Server::OnPlayerStateUpdate(Session& session, Packet& p) {
+	auto& player = session.player;
 
-	p.Read(pos);
-	p.Read(vel);
-	p.Read(ori);
-	p.Read(eyeOri);
+	PlayerStateMessage msg;
+	ReadMessage(p, msg);
+	session.lastStateTick = tick;
 
 	// Save new player state 
-	player->SetPosition(pos);
-	player->SetVelocity(vel);
-	player->SetOrientation(ori);
-	player->SetEyeOrientation(eyeOri);
+	player->SetPosition(msg.position);
+	player->SetVelocity(msg.velocity);
+	player->SetOrientation(msg.orientation);
+	player->SetEyeOrientation(msg.eyeOrientation);
 }
 
-void Server::OnSetBlock(Packet& p) {
-	u16 chunkID, blockType;
-	u8 orientation;
-	ivec3 vxPos;
+void Server::OnSetBlock(Session& session, Packet& p) {
+	SetBlockRequest req;
+	ReadMessage(p, req);
 
-	p.Read(chunkID);
-	p.Read(vxPos);
-	p.Read(blockType);
+	u16 chunkID = req.chunkID;
+	u16 blockType = req.packedBlock;
+	u16 sequence = req.sequence;
+	u8 orientation;
+	ivec3 vxPos = req.position;
+
+	// Lets the client keep or roll back its prediction
+	// Acks follow the broadcast on the channel of the chunk the edit was predicted in
+	auto Ack = [this, &session, sequence, chunkID](bool accepted) {
+		SetBlockAckMessage msg;
+		msg.sequence = sequence;
+		msg.accepted = accepted;
+
+		Packet ack;
+		WriteMessage(ack, msg);
+		ack.reliability = RELIABLE_ORDERED;
+		ack.channel = NetChannel::ForChunk(chunkID);
+		Send(session, ack);
+		session.lastAckedEdit = sequence;
+	};
 
 	orientation = blockType & 3;
 	blockType >>= 2;
 
-	auto playerID = guidToPlayerID[p.guid];
-	if(!playerID) {
-		logger << "Unknown player tried to set block";
+	auto playerID = session.playerID;
+
+	if(!session.TakeEditCredit(1.f)) {
+		Ack(false);
 		return;
 	}
 
 	auto ch = chunkManager->GetChunk(chunkID);
 	if(!ch) {
 		logger << "Client tried to modify chunk that isn't known to server";
+		Ack(false);
 		return;
 	}
 
@@ -272,7 +361,7 @@ void Server::OnSetBlock(Packet& p) {
 			neigh = chunkManager->CreateNeighborhood();
 			neigh->neighborhoodID = ++neighborhoodIDCount;
 			ch->SetNeighborhood(neigh);
-			SendSetNeighborhood(ch);
+			SendSetNeighborhood(ch.get());
 		}
 
 		// Try to get or create a neighboring chunk 
@@ -280,13 +369,14 @@ void Server::OnSetBlock(Packet& p) {
 		auto nchunk = ch->GetOrCreateNeighborContaining(vxPos);
 		if(!nchunk) {
 			logger << "Neighbor chunk creation failed!";
+			Ack(false);
 			return;
 		}
 
 		// If chunkID is zero, it must be new
 		if(!nchunk->chunkID){
 			nchunk->chunkID = ++chunkIDCount;
-			SendNewChunk(nchunk);
+			QueueChunkForAll(nchunk.get());
 		}
 
 		// Get the new position of the block relative
@@ -306,6 +396,26 @@ void Server::OnSetBlock(Packet& p) {
 		auto block = ch->CreateBlock(vxPos, blockType, playerID);
 		if(!block) {
 			logger << "Block creation failed for block type " << blockType;
+
+			// The old block may already be gone, so clients can't just roll back
+			//	to what they had. Tell everyone what the cell actually holds first,
+			//	which the rejected client takes as the state to roll back to
+			if(ch->InBounds(vxPos)) {
+				auto current = ch->GetBlock(vxPos);
+
+				SetBlockMessage msg;
+				msg.chunkID = chunkID;
+				msg.position = vxPos;
+				msg.packedBlock = current? (current->blockID << 2 | (current->orientation & 3)) : 0;
+
+				Packet np;
+				WriteMessage(np, msg);
+				np.reliability = RELIABLE_ORDERED;
+				np.channel = NetChannel::ForChunk(chunkID);
+				network->Broadcast(np);
+			}
+
+			Ack(false);
 			return;
 		}else{
 			block->orientation = orientation;
@@ -316,23 +426,127 @@ void Server::OnSetBlock(Packet& p) {
 	// Packet needs to be copied because vxPos and chunkID can change
 	// TODO: Instead of sending packets immediately, record into buffer and send 
 	//	block updates in bulk
+	SetBlockMessage msg;
+	msg.chunkID = chunkID;
+	msg.position = vxPos;
+	msg.packedBlock = blockType << 2 | (orientation & 3);
+
 	Packet np;
-	np.WriteType(PacketType::SetBlock);
-	np.Write(chunkID);
-	np.Write(vxPos);
-	np.Write<u16>(blockType << 2 | (orientation & 3));
+	WriteMessage(np, msg);
 
 	np.reliability = RELIABLE_ORDERED;
+	np.channel = NetChannel::ForChunk(chunkID);
 
 	network->Broadcast(np);
+	Ack(true);
+}
+
+void Server::OnRegionEdit(Session& session, Packet& p) {
+	RegionEditRequest req;
+	ReadMessage(p, req);
+
+	if(!session.TakeEditCredit(Session::RegionEditCost)) {
+		logger << "Client " << session.playerID << " is editing regions too quickly";
+		return;
+	}
+
+	auto ch = chunkManager->GetChunk(req.chunkID);
+	if(!ch) {
+		logger << "Client tried to edit a region of a chunk that isn't known to server";
+		return;
+	}
+
+	EditRegion(ch.get(), req.edit, session.playerID);
+}
+
+bool Server::EditRegion(Chunk* origin, RegionEdit edit, u16 playerID) {
+	if(edit.op >= RegionOp::Count) return false;
+
+	BlockTemplate* tmpl = nullptr;
+	if(edit.op == RegionOp::Copy || edit.op == RegionOp::Paste) {
+		if(edit.templateID) {
+			if(edit.op == RegionOp::Copy) {
+				tmpl = &templates[edit.templateID];
+			}else{
+				auto it = templates.find(edit.templateID);
+				if(it != templates.end()) tmpl = &it->second;
+			}
+
+		}else if(playerID) {
+			auto player = std::static_pointer_cast<ServerPlayer>(playerManager->GetPlayer(playerID));
+			if(player) tmpl = &player->clipboard;
+		}
+
+		if(!tmpl || (edit.op == RegionOp::Paste && tmpl->IsEmpty())) {
+			logger << "Region edit with missing template " << edit.templateID;
+			return false;
+		}
+	}
+
+	if(edit.op == RegionOp::Paste)
+		edit.max = edit.min + tmpl->size;
+
+	if(!edit.Volume()) return false;
+	if(edit.Volume() > MaxRegionVolume) {
+		logger << "Rejected region edit of " << edit.Volume() << " blocks";
+		return false;
+	}
+
+	if(edit.op == RegionOp::Copy)
+		tmpl->Resize(edit.max - edit.min);
+
+	std::vector<Chunk*> chunks;
+	if(auto neigh = origin->neighborhood.lock()) {
+		for(auto h: neigh->chunks)
+			if(auto c = chunkManager->chunks.Get(h)) chunks.push_back(c);
+	}else{
+		chunks.push_back(origin);
+	}
+
+	// NOTE: Only chunks that already exist are edited. Unlike SetBlock, regions
+	//	reaching past the neighborhood don't create chunks
+	ivec3 chunkSize {origin->width, origin->height, origin->depth};
+	for(auto c: chunks) {
+		if(!c->chunkID) continue;
+
+		auto local = edit.Offset((origin->positionInNeighborhood - c->positionInNeighborhood) * chunkSize);
+
+		if(edit.op == RegionOp::Copy) {
+			CopyRegion(c, local.min, local.max, *tmpl);
+			continue;
+		}
+
+		if(!ApplyRegionEdit(c, local, tmpl, playerID)) continue;
+
+		RegionEditMessage msg;
+		msg.chunkID = c->chunkID;
+		msg.edit = local;
+
+		// Clients don't have the template, so send the part that landed in this chunk.
+		//	Hollow isn't clipped since clipping would move its faces
+		if(edit.op == RegionOp::Paste) {
+			ClipRegion(c, local.min, local.max, msg.edit.min, msg.edit.max);
+			msg.edit.templateID = 0;
+			msg.pasted.Resize(msg.edit.max - msg.edit.min);
+			CopyRegion(c, msg.edit.min, msg.edit.max, msg.pasted);
+		}
+
+		Packet np;
+		WriteMessage(np, msg);
+		np.reliability = RELIABLE_ORDERED;
+		np.channel = NetChannel::ForChunk(c->chunkID);
+		network->Broadcast(np);
+	}
+
+	return true;
 }
 
-void Server::OnInteract(Packet& p) {
-	u16 chunkID;
-	ivec3 vxPos;
+void Server::OnInteract(Session& session, Packet& p) {
+	PlayerInteractMessage msg;
+	ReadMessage(p, msg);
 
-	p.Read(chunkID);
-	p.Read(vxPos);
+	u16 chunkID = msg.chunkID;
+	ivec3 vxPos = msg.position;
 
 	auto ch = chunkManager->GetChunk(chunkID);
 	if(!ch) {
@@ -346,65 +560,148 @@ void Server::OnInteract(Packet& p) {
 		return;
 	}
 
-	auto playerID = guidToPlayerID[p.guid];
-	if(!playerID) {
-		logger << "Unknown player tried to interact with a block";
-		return;
+	if(auto dyn = blk->dynamic){
+		dyn->OnInteract(session.playerID);
 	}
+}
 
-	if(auto dyn = blk->dynamic){
-		dyn->OnInteract(playerID);
+void Server::UpdateChunkStreams() {
+	for(auto& session: sessions) {
+		auto& stream = session->chunkStream;
+		auto guid = session->guid;
+
+		stream.UpdateFocus(session->player->position, chunkManager.get());
+
+		// Credit doesn't accumulate while idle, but a chunk that overshoots
+		//	the budget is paid off over the following ticks
+		stream.byteCredit += ChunkStream::BytesPerTick;
+		if(stream.byteCredit > ChunkStream::BytesPerTick)
+			stream.byteCredit = ChunkStream::BytesPerTick;
+
+		if(!stream.hashesReceived) continue;
+
+		while(stream.byteCredit > 0 && stream.HasPending()) {
+			auto chunk = chunkManager->GetChunk(stream.PopNearest());
+			if(!chunk) continue;
+
+			u32 bytes = 0;
+
+			// A client's hash is only good once. After that it's kept up to date by edits
+			auto cachedIt = stream.clientHashes.find(chunk->chunkID);
+			bool clientHasCopy = cachedIt != stream.clientHashes.end();
+			bool clientCopyCurrent = clientHasCopy && cachedIt->second == chunk->GetBlocksHash();
+			if(clientHasCopy) stream.clientHashes.erase(cachedIt);
+
+			// NOTE: NewChunk must arrive before ChunkDownload, which
+			//	holds as long as both are sent RELIABLE_ORDERED on the chunk's channel
+			bool isNew = stream.sentChunks.insert(chunk->chunkID).second;
+			if(isNew) {
+				bytes += SendNewChunk(chunk.get(), guid, clientCopyCurrent);
+
+				auto neigh = chunk->neighborhood.lock();
+				if(neigh && neigh->neighborhoodID
+				&& stream.knownNeighborhoods.insert(neigh->neighborhoodID).second) {
+					bytes += SendNeighborhoodTransform(neigh, guid);
+				}
+			}
+
+			// A stale copy of a now empty chunk still has to be cleared
+			if(!clientCopyCurrent)
+				bytes += SendChunkContents(chunk.get(), guid, clientHasCopy && !isNew);
+
+			stream.byteCredit -= bytes;
+		}
 	}
 }
 
-void Server::SendNewChunk(std::shared_ptr<Chunk> vc, NetworkGUID guid) {
+void Server::QueueChunkForAll(Chunk* vc) {
+	for(auto& session: sessions)
+		session->chunkStream.Queue(vc->chunkID);
+}
+
+void Server::DestroyChunk(Chunk* vc) {
+	u16 chunkID = vc->chunkID;
+	encodedChunks.erase(chunkID);
+
+	// If the ID is ever reused, the new chunk has to go out as new
+	for(auto& session: sessions)
+		session->chunkStream.sentChunks.erase(chunkID);
+
+	RemoveChunkMessage msg;
+	msg.chunkID = chunkID;
+
+	Packet p;
+	WriteMessage(p, msg);
+	p.reliability = RELIABLE_ORDERED;
+	p.channel = NetChannel::ForChunk(chunkID);
+	network->Broadcast(p);
+
+	chunkManager->DestroyChunk(chunkID);
+}
+
+u32 Server::SendNewChunk(Chunk* vc, NetworkGUID guid, bool cached) {
 	auto neigh = vc->neighborhood.lock();
 	auto neighID = neigh?neigh->neighborhoodID:0;
 
-	Packet packet;
-	packet.WriteType(PacketType::NewChunk);
-	packet.Write(vc->chunkID);
-	packet.Write<u16>(neighID);
-	packet.Write<u8>(vc->width);
-	packet.Write<u8>(vc->height);
-	packet.Write<u8>(vc->depth);
-
-	// If chunk has a neighborhood send it's 
-	//	positionInNeighborhood. Chunk position and 
-	//	rotation will be calculated clientside based 
-	//	on neighborhood transform
-	if(neighID) {
-		packet.Write(vc->positionInNeighborhood);
-
-	}else{
-		packet.Write(vc->position);
-		packet.Write(vc->rotation);
-	}
+	NewChunkMessage msg;
+	msg.chunkID = vc->chunkID;
+	msg.neighborhoodID = neighID;
+	msg.width = vc->width;
+	msg.height = vc->height;
+	msg.depth = vc->depth;
+	msg.positionInNeighborhood = vc->positionInNeighborhood;
+	msg.position = vc->position;
+	msg.rotation = vc->rotation;
+	msg.cached = cached;
 
+	Packet packet;
+	WriteMessage(packet, msg);
 	packet.reliability = RELIABLE_ORDERED;
-	network->Send(packet, guid);
+	packet.channel = NetChannel::ForChunk(vc->chunkID);
+	Send(packet, guid);
+
+	return packet.bitstream.GetNumberOfBytesUsed();
 }
 
-void Server::SendSetNeighborhood(std::shared_ptr<Chunk> vc, NetworkGUID guid) {
+void Server::SendSetNeighborhood(Chunk* vc, NetworkGUID guid) {
 	auto neigh = vc->neighborhood.lock();
 
+	SetChunkNeighborhoodMessage msg;
+	msg.chunkID = vc->chunkID;
+	msg.neighborhoodID = neigh?neigh->neighborhoodID:0;
+	msg.positionInNeighborhood = vc->positionInNeighborhood;
+
 	Packet packet;
-	packet.WriteType(PacketType::SetChunkNeighborhood);
-	packet.Write(vc->chunkID);
-	packet.Write<u16>(neigh?neigh->neighborhoodID:0);
-	packet.Write(vc->positionInNeighborhood);
+	WriteMessage(packet, msg);
+	packet.channel = NetChannel::ForChunk(vc->chunkID);
 
-	network->Send(packet, guid);
+	Send(packet, guid);
 }
 
-void Server::SendChunkContents(std::shared_ptr<Chunk> vc, NetworkGUID guid) {
+u32 Server::SendChunkContents(Chunk* vc, NetworkGUID guid, bool sendEmpty) {
 	if(vc->width > 32
 	|| vc->depth > 32
 	|| vc->height > 32) {
 		logger << "Cannot send chunks of size > 32x32x32";
-		return;
+		return 0;
 	}
 
+	// Chunks start out empty on the client, so there's nothing to send
+	if(vc->IsEmpty() && !sendEmpty) return 0;
+
+	auto& encoded = GetEncodedChunk(vc);
+	for(auto& p: encoded.packets)
+		Send(p, guid);
+
+	return encoded.numBytes;
+}
+
+auto Server::GetEncodedChunk(Chunk* vc) -> EncodedChunk& {
+	auto& encoded = encodedChunks[vc->chunkID];
+	if(!encoded.packets.empty() && encoded.chunk == vc->handle
+	&& encoded.blocksVersion == vc->blocksVersion)
+		return encoded;
+
 	constexpr u16 blockLimit = 245;
 
 	auto blocks = vc->blocks;
@@ -425,56 +722,107 @@ void Server::SendChunkContents(std::shared_ptr<Chunk> vc, NetworkGUID guid) {
 	// TODO: Compression should happen here
 	// A large majority of chunks will be mostly empty
 
-	Packet p;
-	p.reliability = RELIABLE_ORDERED;
-
-	u32 numPackets = 0;
+	encoded.packets.clear();
+	encoded.numBytes = 0;
+	encoded.chunk = vc->handle;
+	encoded.blocksVersion = vc->blocksVersion;
 
-	u16 remaining = numBlocks;
-	while(remaining >= blockLimit) {
-		u16 offset = numBlocks - remaining;
+	for(u16 offset = 0; offset < numBlocks; offset += blockLimit) {
+		u8 count = std::min<u16>(blockLimit, numBlocks - offset);
 
-		p.Reset();
+		Packet p;
 		p.WriteType(PacketType::ChunkDownload);
 		p.Write<u16>(vc->chunkID);
 		p.Write<u16>(offset);
-		p.Write<u8>(blockLimit);
+		p.Write<u8>(count);
 
-		for(u16 i = 0; i < blockLimit; i++)
+		for(u16 i = 0; i < count; i++)
 			p.Write<u16>(packetInfo[i+offset]);
+		p.channel = NetChannel::ForChunk(vc->chunkID);
+		p.reliability = RELIABLE_ORDERED;
 
-		network->Send(p, guid);
-		numPackets++;
-
-		remaining -= blockLimit;
+		encoded.numBytes += p.bitstream.GetNumberOfBytesUsed();
+		encoded.packets.push_back(std::move(p));
 	}
 
-	if(remaining > 0) {
-		u16 offset = numBlocks - remaining;
+	return encoded;
+}
 
-		p.Reset();
-		p.WriteType(PacketType::ChunkDownload);
-		p.Write<u16>(vc->chunkID);
-		p.Write<u16>(offset);
-		p.Write<u8>(remaining);
+u32 Server::SendNeighborhoodTransform(std::shared_ptr<ChunkNeighborhood> neigh, NetworkGUID guid) {
+	vec3 position;
+	quat rotation;
+	GetReplicatedTransform(neigh.get(), position, rotation);
 
-		for(u16 i = 0; i < remaining; i++)
-			p.Write<u16>(packetInfo[i+offset]);
+	NeighborhoodTransformMessage msg;
+	msg.neighborhoodID = neigh->neighborhoodID;
+	msg.position = position;
+	msg.rotation = rotation;
+	msg.velocity = neigh->velocity;
+	msg.angularVelocity = neigh->angularVelocity;
+	msg.pivot = neigh->pivot;
 
-		numPackets++;
-		network->Send(p, guid);
+	Packet p;
+	WriteMessage(p, msg);
+
+	// NOTE: Every neighborhood shares one channel, so these can't be sequenced.
+	//	A newer transform for one neighborhood would drop an older one for
+	//	another, which sentNeighborhoodStates would still count as delivered
+	p.reliability = RELIABLE_ORDERED;
+	Send(p, guid);
+
+	if(guid == RakNet::UNASSIGNED_RAKNET_GUID) {
+		sentNeighborhoodStates[neigh->neighborhoodID] = NeighborhoodState{
+			position, rotation, neigh->velocity, neigh->angularVelocity, neigh->pivot, tick};
 	}
 
-	// logger << "Sent " << numPackets << " packets";
+	return p.bitstream.GetNumberOfBytesUsed();
 }
 
-void Server::SendNeighborhoodTransform(std::shared_ptr<ChunkNeighborhood> neigh, NetworkGUID guid) {
-	Packet p;
-	p.WriteType(PacketType::SetNeighborhoodTransform);
-	p.Write<u16>(neigh->neighborhoodID);
-	p.Write(neigh->position);
-	p.Write(neigh->rotation);
-	// TODO: Neighborhood velocities
+void Server::GetReplicatedTransform(ChunkNeighborhood* neigh, vec3& position, quat& rotation) {
+	u32 publishedTick;
+	if(!physics->GetTransform(neigh->neighborhoodID, position, rotation, publishedTick)) {
+		position = neigh->position;
+		rotation = neigh->rotation;
+		return;
+	}
+
+	// The physics thread can be up to a step behind the main thread. Without
+	//	this, that lag alone reads as drift on anything spinning
+	ChunkNeighborhood::ExtrapolatePose(position, rotation, neigh->pivot,
+		neigh->velocity, neigh->angularVelocity, (tick - publishedTick) * Network::TickInterval);
+}
 
-	network->Send(p, guid);
+void Server::UpdateNeighborhoodReplication() {
+	for(auto& neigh: chunkManager->neighborhoods) {
+		auto it = sentNeighborhoodStates.find(neigh->neighborhoodID);
+		if(it == sentNeighborhoodStates.end()) {
+			SendNeighborhoodTransform(neigh);
+			continue;
+		}
+
+		auto& sent = it->second;
+		if(sent.velocity != neigh->velocity || sent.angularVelocity != neigh->angularVelocity
+			|| sent.pivot != neigh->pivot) {
+			SendNeighborhoodTransform(neigh);
+			continue;
+		}
+
+		// Predict where clients think the neighborhood is
+		vec3 predictedPosition = sent.position;
+		quat predictedRotation = sent.rotation;
+		ChunkNeighborhood::ExtrapolatePose(predictedPosition, predictedRotation, sent.pivot,
+			sent.velocity, sent.angularVelocity, (tick - sent.tick) * Network::TickInterval);
+
+		vec3 position;
+		quat rotation;
+		GetReplicatedTransform(neigh.get(), position, rotation);
+
+		f32 cosHalfAngle = std::min(std::abs(glm::dot(predictedRotation, rotation)), 1.f);
+		f32 angleError = 2.f * std::acos(cosHalfAngle);
+
+		if(glm::length(predictedPosition - position) > NeighborhoodPositionTolerance
+			|| angleError > NeighborhoodAngleTolerance) {
+			SendNeighborhoodTransform(neigh);
+		}
+	}
 }
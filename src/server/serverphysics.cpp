@@ -0,0 +1,134 @@
+#include "serverphysics.h"
+#include "chunkmanager.h"
+#include "physics.h"
+
+static Log logger{"ServerPhysics"};
+
+using namespace std::chrono;
+
+ServerPhysics::ServerPhysics() : worldTick{0}, frontBuffer{0}, running{false}, stepGeneration{0}, workersDone{0}, nextSpace{0} {}
+
+ServerPhysics::~ServerPhysics() {
+	Stop();
+}
+
+void ServerPhysics::Start(u32 workerCount) {
+	if(running) return;
+	running = true;
+
+	for(u32 i = 0; i < workerCount; i++)
+		workers.emplace_back(&ServerPhysics::WorkerRun, this);
+
+	thread = std::thread{&ServerPhysics::Run, this};
+	logger << "Started with " << workerCount << " workers";
+}
+
+void ServerPhysics::Stop() {
+	if(!running) return;
+
+	{	std::lock_guard<std::mutex> lock{stepMutex};
+		running = false;
+	}
+	stepBegin.notify_all();
+
+	if(thread.joinable()) thread.join();
+	for(auto& w: workers) w.join();
+	workers.clear();
+}
+
+bool ServerPhysics::GetTransform(u16 neighborhoodID, vec3& position, quat& rotation, u32& tick) {
+	std::lock_guard<std::mutex> lock{publishMutex};
+
+	for(auto& t: transformBuffers[frontBuffer]) {
+		if(t.neighborhoodID != neighborhoodID) continue;
+
+		position = t.position;
+		rotation = t.rotation;
+		tick = t.tick;
+		return true;
+	}
+
+	return false;
+}
+
+void ServerPhysics::Run() {
+	auto stepDuration = duration_cast<steady_clock::duration>(duration<f32>{TimeStep});
+	auto nextStep = steady_clock::now();
+
+	while(running) {
+		std::this_thread::sleep_until(nextStep);
+		nextStep += stepDuration;
+
+		std::lock_guard<std::mutex> lock{worldMutex};
+
+		for(auto space: Physics::spaces)
+			space->world->setGravity(o2bt(space->ToLocalDir(Physics::gravity)));
+
+		// Kick workers, help out, then wait for stragglers
+		nextSpace = 0;
+		{	std::lock_guard<std::mutex> stepLock{stepMutex};
+			workersDone = 0;
+			stepGeneration++;
+		}
+		stepBegin.notify_all();
+
+		StepSpaces();
+
+		{	std::unique_lock<std::mutex> stepLock{stepMutex};
+			stepEnd.wait(stepLock, [this]{ return workersDone == workers.size(); });
+		}
+
+		Publish();
+	}
+}
+
+void ServerPhysics::WorkerRun() {
+	u64 lastGeneration = 0;
+
+	while(true) {
+		{	std::unique_lock<std::mutex> stepLock{stepMutex};
+			stepBegin.wait(stepLock, [&]{ return !running || stepGeneration != lastGeneration; });
+
+			// A step that has already begun still needs finishing
+			if(stepGeneration == lastGeneration) return;
+			lastGeneration = stepGeneration;
+		}
+
+		StepSpaces();
+
+		{	std::lock_guard<std::mutex> stepLock{stepMutex};
+			workersDone++;
+		}
+		stepEnd.notify_one();
+	}
+}
+
+void ServerPhysics::StepSpaces() {
+	// Index 0 is the global world
+	u32 spaceCount = Physics::spaces.size() + 1;
+
+	u32 i;
+	while((i = nextSpace++) < spaceCount) {
+		auto space = i? Physics::spaces[i-1] : &Physics::globalSpace;
+		space->world->stepSimulation(TimeStep, 1, TimeStep);
+	}
+}
+
+void ServerPhysics::Publish() {
+	auto& back = transformBuffers[frontBuffer^1];
+	back.clear();
+
+	for(auto& neigh: ChunkManager::Instance()->neighborhoods) {
+		auto& trans = neigh->rigidbody->getWorldTransform();
+
+		NeighborhoodTransform t;
+		t.neighborhoodID = neigh->neighborhoodID;
+		t.position = bt2o(trans.getOrigin());
+		t.rotation = bt2o(trans.getRotation());
+		t.tick = worldTick;
+		back.push_back(t);
+	}
+
+	std::lock_guard<std::mutex> lock{publishMutex};
+	frontBuffer ^= 1;
+}
@@ -0,0 +1,58 @@
+#include "session.h"
+#include "serverplayer.h"
+
+Session::Session() : playerID{0}, stats{0, 0, 0, 0, 0},
+	connectTick{0}, lastReceiveTick{0}, lastStateTick{0}, lastAckedEdit{0},
+	editCredit{EditBurst} {}
+
+void Session::Receive(const Packet& p, u32 tick) {
+	stats.bytesReceived += p.bitstream.GetNumberOfBytesUsed();
+	stats.packetsReceived++;
+	lastReceiveTick = tick;
+}
+
+void Session::Sent(const Packet& p) {
+	stats.bytesSent += p.bitstream.GetNumberOfBytesUsed();
+	stats.packetsSent++;
+}
+
+void Session::Update(f32 dt) {
+	editCredit += EditsPerSecond*dt;
+	if(editCredit > EditBurst) editCredit = EditBurst;
+}
+
+bool Session::TakeEditCredit(f32 cost) {
+	if(editCredit < cost) {
+		stats.editsRejected++;
+		return false;
+	}
+
+	editCredit -= cost;
+	return true;
+}
+
+Session* SessionTable::Open(NetworkGUID guid) {
+	if(auto s = Find(guid)) return s;
+
+	auto session = std::make_shared<Session>();
+	session->guid = guid;
+
+	auto h = sessions.Add(session);
+	guidToSession[guid.g] = h;
+	return session.get();
+}
+
+void SessionTable::Close(NetworkGUID guid) {
+	auto it = guidToSession.find(guid.g);
+	if(it == guidToSession.end()) return;
+
+	sessions.Remove(it->second);
+	guidToSession.erase(it);
+}
+
+Session* SessionTable::Find(NetworkGUID guid) const {
+	auto it = guidToSession.find(guid.g);
+	if(it == guidToSession.end()) return nullptr;
+
+	return sessions.Get(it->second);
+}
@@ -1,3 +1,4 @@
+#include "blockscheduler.h"
 #include "block.h"
 #include "chunk.h"
 #include "blocks/basic.h"
@@ -5,7 +6,7 @@
 void BlockRegistry::InitBlockInfo() {
 	Register("steel", 		GeometryType::Cube, {0,0,0,0,0,0}, true);
 	Register("steelslab", 	GeometryType::Slab, {0,0,0,0,0,0}, true);
-	Register("lightthing", 	GeometryType::Cube, {1,1,1,1,1,1}, true);
+	Register("lightthing", 	GeometryType::Cube, {1,1,1,1,1,1}, true, 15);
 	Register("ramp",		GeometryType::Slope,{0,0,0,0,4,0}, true);
 	Register("pole",		GeometryType::Cross,{2,2,2,2,2,2}, false);
 
@@ -33,7 +34,7 @@ BlockRegistry* BlockRegistry::Get() {
 }
 
 void BlockRegistry::RegisterWithFactory(std::string name, GeometryType geometry, 
-		std::array<u8, 6> textures, bool doesOcclude, BlockFactory* factory) {
+		std::array<u8, 6> textures, bool doesOcclude, u8 lightEmission, BlockFactory* factory) {
 
 	auto blockRegistry = Get();
 
@@ -44,14 +45,15 @@ void BlockRegistry::RegisterWithFactory(std::string name, GeometryType geometry,
 	bi->geometry = geometry;
 	bi->textures = textures;
 	bi->doesOcclude = doesOcclude;
+	bi->lightEmission = lightEmission;
 	bi->factory = factory;
 	factory->blockID = bi->blockID;
 }
 
 void BlockRegistry::Register(std::string name, GeometryType geometry, 
-		std::array<u8, 6> textures, bool doesOcclude) {
+		std::array<u8, 6> textures, bool doesOcclude, u8 lightEmission) {
 
-	RegisterWithFactory(name, geometry, textures, doesOcclude, new BlockFactory);
+	RegisterWithFactory(name, geometry, textures, doesOcclude, lightEmission, new BlockFactory);
 }
 
 BlockInfo* BlockRegistry::GetBlockInfo(u16 blockID) {
@@ -119,6 +121,12 @@ bool Block::IsValid() {
 	return blockID > 0;
 }
 
+DynamicBlock::~DynamicBlock() {
+	// Don't leave the scheduler holding a dangling pointer
+	if(awakeIndex != NotAwake || wakeTick)
+		BlockScheduler::Get()->Sleep(this);
+}
+
 // TODO: Nope. Not much need for this
 mat4 DynamicBlock::GetOrientationMat() {
 	return glm::rotate<f32>(-PI/2.f*block->orientation, vec3{0,1,0});
@@ -0,0 +1,445 @@
+#include "chunkmanager.h"
+#include "blocklight.h"
+#include "block.h"
+#include "chunk.h"
+
+static Log logger{"BlockLight"};
+
+LightField::LightField(ivec3 s) : size{s}, dirty{false}, publishedVersion{0} {
+	u32 numCells = size.x*size.y*size.z;
+	light.assign(numCells, 0);
+	opaque.assign(numCells, 0);
+	emission.assign(numCells, 0);
+}
+
+bool LightField::InBounds(ivec3 p) const {
+	return !((u32)p.x >= (u32)size.x || (u32)p.y >= (u32)size.y || (u32)p.z >= (u32)size.z);
+}
+
+LightVolume::LightVolume() : queued{false}, busy{false}, chunkSize{0} {}
+
+u64 LightVolume::ChunkKey(ivec3 c) {
+	constexpr u64 mask = (1ull<<21)-1;
+	return ((u64)c.x & mask) << 42 | ((u64)c.y & mask) << 21 | ((u64)c.z & mask);
+}
+
+LightField* LightVolume::GetField(ivec3 c) {
+	auto it = fields.find(ChunkKey(c));
+	return (it == fields.end())? nullptr : it->second.get();
+}
+
+/*
+	Propagation. Positions are in neighborhood voxel space
+*/
+namespace {
+	struct Cell {
+		LightField* field;
+		u32 index;
+	};
+
+	struct LightRemoval {
+		ivec3 position;
+		u8 level;
+	};
+
+	struct Propagation {
+		LightVolume* volume;
+		std::vector<ivec3> adds;
+		std::vector<LightRemoval> removals;
+
+		// Most lookups land in the same chunk as the last
+		LightField* lastField = nullptr;
+
+		static s32 FloorDiv(s32 a, s32 b) { return (a - (a < 0? b-1 : 0)) / b; }
+
+		bool Locate(ivec3 p, Cell& cell) {
+			if(lastField) {
+				auto local = p - lastField->chunkPosition*lastField->size;
+				if(lastField->InBounds(local)) {
+					cell = Cell{lastField, lastField->Index(local)};
+					return true;
+				}
+			}
+
+			auto& cs = volume->chunkSize;
+			ivec3 c {FloorDiv(p.x, cs.x), FloorDiv(p.y, cs.y), FloorDiv(p.z, cs.z)};
+
+			auto field = volume->GetField(c);
+			if(!field) return false;
+
+			lastField = field;
+			cell = Cell{field, field->Index(p - c*cs)};
+			return true;
+		}
+
+		void SetLight(Cell c, u8 level) {
+			c.field->light[c.index] = level;
+			c.field->dirty = true;
+		}
+
+		void Run() {
+			// Clear light that came from removed sources. Anything brighter bordering
+			//	the cleared area is queued to refill it
+			while(!removals.empty()) {
+				auto r = removals.back();
+				removals.pop_back();
+
+				for(u8 f = 0; f < ChunkFace::Count; f++) {
+					auto np = r.position + ChunkFace::Direction(f);
+					Cell n;
+					if(!Locate(np, n)) continue;
+
+					u8 nl = n.field->light[n.index];
+					if(!nl) continue;
+
+					if(nl < r.level) {
+						SetLight(n, 0);
+						removals.push_back(LightRemoval{np, nl});
+
+						if(u8 e = n.field->emission[n.index]) {
+							SetLight(n, e);
+							adds.push_back(np);
+						}
+					}else{
+						adds.push_back(np);
+					}
+				}
+			}
+
+			for(u32 i = 0; i < adds.size(); i++) {
+				auto p = adds[i];
+				Cell c;
+				if(!Locate(p, c)) continue;
+
+				u8 level = c.field->light[c.index];
+				if(level <= 1) continue;
+
+				for(u8 f = 0; f < ChunkFace::Count; f++) {
+					auto np = p + ChunkFace::Direction(f);
+					Cell n;
+					if(!Locate(np, n) || n.field->opaque[n.index]) continue;
+					if(n.field->light[n.index] + 1 >= level) continue;
+
+					SetLight(n, level-1);
+					adds.push_back(np);
+				}
+			}
+
+			adds.clear();
+		}
+
+		void QueueLitNeighbors(ivec3 p) {
+			for(u8 f = 0; f < ChunkFace::Count; f++) {
+				auto np = p + ChunkFace::Direction(f);
+				Cell n;
+				if(Locate(np, n) && n.field->light[n.index])
+					adds.push_back(np);
+			}
+		}
+
+		// Calls fn with the neighborhood position of every cell on a field's faces
+		template<class Fn>
+		static void ForEachFaceCell(LightField* field, Fn fn) {
+			auto s = field->size;
+			auto origin = field->chunkPosition*s;
+
+			for(s32 x = 0; x < s.x; x++)
+			for(s32 y = 0; y < s.y; y++)
+			for(s32 z = 0; z < s.z; z++) {
+				bool face = x == 0 || y == 0 || z == 0 || x == s.x-1 || y == s.y-1 || z == s.z-1;
+				if(!face) {
+					// Skip to the far z face
+					z = s.z-2;
+					continue;
+				}
+
+				fn(origin + ivec3{x,y,z}, field->Index(ivec3{x,y,z}));
+			}
+		}
+
+		void AddField(std::shared_ptr<LightField> field) {
+			if(volume->fields.empty()) volume->chunkSize = field->size;
+			volume->fields[LightVolume::ChunkKey(field->chunkPosition)] = field;
+			lastField = nullptr;
+
+			auto origin = field->chunkPosition*field->size;
+			for(u32 i = 0; i < field->emission.size(); i++) {
+				if(!field->emission[i]) continue;
+
+				auto s = field->size;
+				field->light[i] = field->emission[i];
+				adds.push_back(origin + ivec3{(s32)(i/(s.z*s.y)), (s32)((i/s.z)%s.y), (s32)(i%s.z)});
+			}
+
+			// Light already in neighbors spills in
+			ForEachFaceCell(field.get(), [this](ivec3 p, u32) { QueueLitNeighbors(p); });
+			field->dirty = true;
+		}
+
+		void RemoveField(std::shared_ptr<LightField> field) {
+			volume->fields.erase(LightVolume::ChunkKey(field->chunkPosition));
+			lastField = nullptr;
+
+			// Whatever the field lit in its neighbors goes with it
+			ForEachFaceCell(field.get(), [this, &field](ivec3 p, u32 i) {
+				if(u8 l = field->light[i]) removals.push_back(LightRemoval{p, l});
+			});
+
+			// Its neighbors' margins need republishing
+			for(u8 f = 0; f < ChunkFace::Count; f++)
+				if(auto n = volume->GetField(field->chunkPosition + ChunkFace::Direction(f)))
+					n->dirty = true;
+		}
+
+		void Edit(LightField* field, const LightEdit& e) {
+			auto s = field->size;
+			auto p = field->chunkPosition*s
+				+ ivec3{(s32)(e.index/(s.z*s.y)), (s32)((e.index/s.z)%s.y), (s32)(e.index%s.z)};
+
+			if(field->opaque[e.index] == e.opaque && field->emission[e.index] == e.emission) return;
+
+			field->opaque[e.index] = e.opaque;
+			field->emission[e.index] = e.emission;
+
+			Cell c {field, e.index};
+			if(u8 old = field->light[e.index]) {
+				SetLight(c, 0);
+				removals.push_back(LightRemoval{p, old});
+			}
+
+			if(e.emission) {
+				SetLight(c, e.emission);
+				adds.push_back(p);
+			}
+
+			if(!e.opaque) QueueLitNeighbors(p);
+		}
+	};
+}
+
+// Copies a field's light and the faces of its neighbors that border it
+static void PublishField(LightVolume* volume, LightField* field) {
+	auto s = field->size;
+	u32 mw = s.x+2, mh = s.y+2, md = s.z+2;
+	auto MarginIndex = [mh, md](ivec3 p) { return p.z + p.y*md + p.x*md*mh; };
+
+	std::vector<u8> data(mw*mh*md, 0);
+	for(s32 x = 0; x < s.x; x++)
+	for(s32 y = 0; y < s.y; y++)
+	for(s32 z = 0; z < s.z; z++)
+		data[MarginIndex(ivec3{x,y,z}+1)] = field->light[field->Index(ivec3{x,y,z})];
+
+	for(u8 f = 0; f < ChunkFace::Count; f++) {
+		auto dir = ChunkFace::Direction(f);
+		auto n = volume->GetField(field->chunkPosition + dir);
+		if(!n) continue;
+
+		u8 axis = f/2;
+		u8 ua = (axis+1)%3;
+		u8 va = (axis+2)%3;
+
+		// Margin layer in this field, and the layer of the neighbor it mirrors
+		ivec3 mp, np;
+		mp[axis] = (f%2 == 0)? s[axis]+1 : 0;
+		np[axis] = (f%2 == 0)? 0 : s[axis]-1;
+
+		for(s32 u = 0; u < s[ua]; u++)
+		for(s32 v = 0; v < s[va]; v++) {
+			mp[ua] = u+1; mp[va] = v+1;
+			np[ua] = u; np[va] = v;
+			data[MarginIndex(mp)] = n->light[n->Index(np)];
+		}
+	}
+
+	std::lock_guard<std::mutex> lock{field->publishMutex};
+	field->published.swap(data);
+	field->publishedVersion++;
+}
+
+static void Propagate(LightVolume* volume, std::vector<LightVolume::Command>& commands) {
+	Propagation prop;
+	prop.volume = volume;
+
+	for(auto& cmd: commands) {
+		switch(cmd.type) {
+		case LightVolume::Command::Add: prop.AddField(cmd.field); break;
+		case LightVolume::Command::Remove: prop.RemoveField(cmd.field); break;
+		case LightVolume::Command::Edit:
+			// Edits can trail the removal of their field
+			if(volume->GetField(cmd.field->chunkPosition) != cmd.field.get()) break;
+			for(auto& e: cmd.edits) prop.Edit(cmd.field.get(), e);
+			break;
+		}
+	}
+
+	// Removals are run first, so nothing refills from light that's about to go
+	prop.Run();
+
+	// Cells on a face also appear in a neighbor's margin
+	std::vector<LightField*> dirty;
+	for(auto& it: volume->fields) {
+		if(!it.second->dirty) continue;
+		dirty.push_back(it.second.get());
+	}
+
+	std::vector<LightField*> publish = dirty;
+	for(auto field: dirty) {
+		field->dirty = false;
+		for(u8 f = 0; f < ChunkFace::Count; f++)
+			if(auto n = volume->GetField(field->chunkPosition + ChunkFace::Direction(f)))
+				if(!n->dirty) publish.push_back(n);
+	}
+
+	std::sort(publish.begin(), publish.end());
+	publish.erase(std::unique(publish.begin(), publish.end()), publish.end());
+
+	for(auto field: publish)
+		PublishField(volume, field);
+}
+
+/*
+	Engine
+*/
+BlockLightEngine::BlockLightEngine() : running{false} {}
+
+BlockLightEngine::~BlockLightEngine() {
+	Stop();
+}
+
+void BlockLightEngine::Start(u32 workerCount) {
+	if(running) return;
+	running = true;
+
+	for(u32 i = 0; i < workerCount; i++)
+		workers.emplace_back(&BlockLightEngine::WorkerRun, this);
+
+	logger << "Started with " << workerCount << " workers";
+}
+
+void BlockLightEngine::Stop() {
+	if(!running) return;
+
+	{	std::lock_guard<std::mutex> lock{mutex};
+		running = false;
+	}
+	wake.notify_all();
+
+	for(auto& w: workers) w.join();
+	workers.clear();
+}
+
+void BlockLightEngine::Submit(std::shared_ptr<LightVolume> volume, LightVolume::Command&& cmd) {
+	{	std::lock_guard<std::mutex> lock{mutex};
+		volume->commands.push_back(std::move(cmd));
+
+		// A busy volume is requeued by its worker when it finishes
+		if(volume->queued || volume->busy) return;
+
+		volume->queued = true;
+		readyVolumes.push_back(volume);
+	}
+
+	wake.notify_one();
+}
+
+void BlockLightEngine::WorkerRun() {
+	std::vector<LightVolume::Command> commands;
+
+	while(true) {
+		std::shared_ptr<LightVolume> volume;
+
+		{	std::unique_lock<std::mutex> lock{mutex};
+			wake.wait(lock, [this]{ return !running || !readyVolumes.empty(); });
+			if(!running) return;
+
+			volume = readyVolumes.front();
+			readyVolumes.pop_front();
+
+			volume->queued = false;
+			volume->busy = true;
+			commands.swap(volume->commands);
+		}
+
+		Propagate(volume.get(), commands);
+		commands.clear();
+
+		{	std::lock_guard<std::mutex> lock{mutex};
+			volume->busy = false;
+
+			if(!volume->commands.empty()) {
+				volume->queued = true;
+				readyVolumes.push_back(volume);
+				wake.notify_one();
+			}
+		}
+	}
+}
+
+void BlockLightEngine::Update(ChunkManager* manager) {
+	// Drop chunks that were destroyed or moved. Moved chunks are added again below
+	for(auto it = registrations.begin(); it != registrations.end();) {
+		auto ch = manager->chunks.Get(it->chunk);
+		auto neigh = ch? ch->neighborhood.lock() : nullptr;
+
+		if(neigh && neigh->lightVolume == it->volume && ch->positionInNeighborhood == it->chunkPosition) {
+			++it;
+			continue;
+		}
+
+		LightVolume::Command cmd;
+		cmd.type = LightVolume::Command::Remove;
+		cmd.field = it->field;
+		Submit(it->volume, std::move(cmd));
+
+		if(ch) ch->lightField.reset();
+		it = registrations.erase(it);
+	}
+
+	for(auto& ch: manager->chunks) {
+		if(ch->lightField) continue;
+
+		// Chunks outside of a neighborhood don't get any light
+		auto neigh = ch->neighborhood.lock();
+		if(!neigh) continue;
+
+		if(!neigh->lightVolume)
+			neigh->lightVolume = std::make_shared<LightVolume>();
+
+		auto field = std::make_shared<LightField>(ivec3{ch->width, ch->height, ch->depth});
+		field->chunkPosition = ch->positionInNeighborhood;
+
+		for(u32 i = 0; i < field->opaque.size(); i++) {
+			auto bi = ch->blocks[i].GetInfo();
+			field->opaque[i] = bi && bi->doesOcclude;
+			field->emission[i] = bi? bi->lightEmission : 0;
+		}
+
+		LightVolume::Command cmd;
+		cmd.type = LightVolume::Command::Add;
+		cmd.field = field;
+		Submit(neigh->lightVolume, std::move(cmd));
+
+		// Anything staged from here on is newer than the snapshot
+		ch->lightField = field;
+		registrations.push_back(Registration{ch->handle, field, neigh->lightVolume, ch->positionInNeighborhood, 0});
+	}
+
+	for(auto& reg: registrations) {
+		auto& field = reg.field;
+
+		if(!field->stagedEdits.empty()) {
+			LightVolume::Command cmd;
+			cmd.type = LightVolume::Command::Edit;
+			cmd.field = field;
+			cmd.edits.swap(field->stagedEdits);
+			Submit(reg.volume, std::move(cmd));
+		}
+
+		if(field->publishedVersion == reg.appliedVersion) continue;
+
+		auto ch = manager->chunks.Get(reg.chunk);
+		std::lock_guard<std::mutex> lock{field->publishMutex};
+		ch->SetLightData(&field->published[0]);
+		reg.appliedVersion = field->publishedVersion;
+	}
+}
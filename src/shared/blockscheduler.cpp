@@ -0,0 +1,99 @@
+#include "blockscheduler.h"
+#include "block.h"
+
+static Log logger{"BlockScheduler"};
+
+std::shared_ptr<BlockScheduler> BlockScheduler::Get() {
+	static std::weak_ptr<BlockScheduler> wp;
+	std::shared_ptr<BlockScheduler> p;
+
+	if(!(p = wp.lock()))
+		wp = (p = std::make_shared<BlockScheduler>());
+
+	return p;
+}
+
+BlockScheduler::BlockScheduler() : currentTick{0}, cursor{0}, tickBudget{DefaultTickBudget} {}
+
+void BlockScheduler::Wake(DynamicBlock* b) {
+	CancelWakeup(b);
+	if(b->awakeIndex != DynamicBlock::NotAwake) return;
+
+	b->awakeIndex = awake.size();
+	awake.push_back(b);
+}
+
+void BlockScheduler::WakeAfter(DynamicBlock* b, u32 ticks) {
+	RemoveAwake(b);
+	CancelWakeup(b);
+
+	b->wakeTick = currentTick + std::max(ticks, 1u);
+	wheel[b->wakeTick % WheelSize].push_back(b);
+}
+
+void BlockScheduler::Sleep(DynamicBlock* b) {
+	RemoveAwake(b);
+	CancelWakeup(b);
+}
+
+bool BlockScheduler::IsScheduled(DynamicBlock* b) {
+	return b->awakeIndex != DynamicBlock::NotAwake || b->wakeTick;
+}
+
+void BlockScheduler::Tick() {
+	currentTick++;
+
+	// Move due blocks from this bucket to the awake list.
+	// Blocks due on a later lap stay where they are
+	auto& bucket = wheel[currentTick % WheelSize];
+	for(u32 i = 0; i < bucket.size();) {
+		auto b = bucket[i];
+		if(b->wakeTick > currentTick) {
+			i++;
+			continue;
+		}
+
+		bucket[i] = bucket.back();
+		bucket.pop_back();
+
+		b->wakeTick = 0;
+		Wake(b);
+	}
+
+	// Blocks can go to sleep or destroy others during Update, which swaps
+	//	the last awake block into their place. Only advance if the 
+	//	block under the cursor is the one just updated
+	u32 count = std::min<u32>(tickBudget, awake.size());
+	for(u32 i = 0; i < count && !awake.empty(); i++) {
+		if(cursor >= awake.size()) cursor = 0;
+
+		auto b = awake[cursor];
+		b->Update();
+
+		if(cursor < awake.size() && awake[cursor] == b) cursor++;
+	}
+}
+
+void BlockScheduler::RemoveAwake(DynamicBlock* b) {
+	if(b->awakeIndex == DynamicBlock::NotAwake) return;
+
+	auto last = awake.back();
+	awake[b->awakeIndex] = last;
+	last->awakeIndex = b->awakeIndex;
+	awake.pop_back();
+
+	b->awakeIndex = DynamicBlock::NotAwake;
+}
+
+void BlockScheduler::CancelWakeup(DynamicBlock* b) {
+	if(!b->wakeTick) return;
+
+	auto& bucket = wheel[b->wakeTick % WheelSize];
+	auto it = std::find(bucket.begin(), bucket.end(), b);
+	if(it != bucket.end()) {
+		*it = bucket.back();
+		bucket.pop_back();
+	}
+
+	b->wakeTick = 0;
+}
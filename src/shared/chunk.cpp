@@ -1,5 +1,6 @@
 #include "chunkmeshbuilder.h"
 #include "chunkmanager.h"
+#include "blocklight.h"
 #include "physics.h"
 #include "block.h"
 #include "chunk.h"
@@ -8,6 +9,25 @@
 
 static Log logger{"Chunk"};
 
+// splitmix64 finaliser
+static u64 HashMix(u64 x) {
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+// Contribution of a single voxel to Chunk::contentHash
+// Terms are summed so a voxel can be swapped out without rehashing the chunk
+static u64 VoxelHashTerm(u32 idx, u8 geometry, u8 rotation, u8 occlusion) {
+	return HashMix((u64)idx << 24 | (u64)geometry << 16 | (u64)rotation << 8 | occlusion);
+}
+
+// Contribution of a single lit voxel to Chunk::lightHash
+static u64 LightHashTerm(u32 idx, u8 light) {
+	return HashMix(1ull << 56 | (u64)idx << 8 | light);
+}
+
 Chunk::Chunk(u8 w, u8 h, u8 d) 
 	: width{w}, height{h}, depth{d} {
 
@@ -17,34 +37,43 @@ Chunk::Chunk(u8 w, u8 h, u8 d)
 	geometryData = new u8[size];
 	rotationData = new u8[size];
 	occlusionData = new u8[size];
+	lightData = new u8[size];
 
 	blocks = new Block[width*height*depth];
 	
 	memset(geometryData, 0, size);
 	memset(rotationData, 0, size);
 	memset(occlusionData, 255, size);
+	memset(lightData, 0, size);
+
+	contentHash = VoxelHashTerm(~0u, width, height, depth);
+	for(u32 i = 0; i < size; i++)
+		contentHash += VoxelHashTerm(i, 0, 0, 255);
+
+	lightHash = 0;
 
 	memset(blocks, 0, width*height*depth * sizeof(Block));
 
-	numQuads = 0;
+	// Empty chunks can be seen through from any direction
+	memset(faceConnectivity, (1<<ChunkFace::Count)-1, sizeof(faceConnectivity));
+
+	voxelVersion = 1;
+	blocksVersion = 1;
+	blocksHashVersion = 0;
+	blocksHash = 0;
 	blocksDirty = false;
-	renderDirty = true;
+	marginsDirty = false;
 	physicsDirty = true;
 
+	blockCount = 0;
+	lastOpaqueFaces = 0;
+	memset(opaqueFaceCells, 0, sizeof(opaqueFaceCells));
+
 	position = vec3{0.f};
 	rotation = quat{1,0,0,0};
 
-	btScalar mass = 0.f;
-	btVector3 inertia {0,0,0};
-
-	// TODO: When shit starts moving, chunks will probably need 
-	//	their own MotionState
-	auto ms = new btDefaultMotionState{btTransform{}};
-
-	RigidBodyInfo bodyInfo{mass, ms, nullptr, inertia};
-	rigidbody = new RigidBody{bodyInfo};
-
-	collider = nullptr;
+	// Collision is handled by the neighborhood's rigidbody
+	compoundIndex = -1;
 }
 
 Chunk::~Chunk() {
@@ -54,22 +83,13 @@ Chunk::~Chunk() {
 	rotationData = nullptr;
 
 	delete[] occlusionData;
+	delete[] lightData;
 	occlusionData = nullptr;
+	lightData = nullptr;
 
-	if(numQuads){
-		Physics::world->removeRigidBody(rigidbody);
-	}
-
-	if(auto tmsh = (btBvhTriangleMeshShape*) collider) {
-		if(auto mi = tmsh->getMeshInterface())
-			delete mi;
-
-		delete tmsh;
-	}
-
-	delete rigidbody->getMotionState();
-	delete rigidbody;
-	rigidbody = nullptr;
+	if(auto neigh = neighborhood.lock())
+		neigh->RemoveChunkCollider(this);
+	collider.reset();
 
 	for(u32 i = 0; i < (u32)width*depth*height; i++) {
 		auto block = &blocks[i];
@@ -92,65 +112,75 @@ static btVector3 VoxIntToVert(u32 vert) {
 	return o2bt(offset);
 }
 
-void Chunk::GenerateCollider(std::shared_ptr<ChunkMeshBuilder> meshBuilder) {
-	// If mesh is valid then collider is assumed to exist
-	// so destroy it
-	if(numQuads) {
-		Physics::world->removeRigidBody(rigidbody);
-		delete ((btBvhTriangleMeshShape*) collider)->getMeshInterface();
-		delete collider;
-		collider = nullptr;
-	}
-
-	numQuads = meshBuilder->BuildMesh(self.lock());
-
-	// If a mesh was generated, generate a new collider
-	if(numQuads) {
-		auto trimesh = new btTriangleMesh();
-		u32* chunkVerts = (u32*)meshBuilder->vertexBuildBuffer;
-		for(u64 i = 0; i < numQuads; i++) {
-			btVector3 vs[] = {
-				VoxIntToVert(chunkVerts[i*4+0]),
-				VoxIntToVert(chunkVerts[i*4+1]),
-				VoxIntToVert(chunkVerts[i*4+2]),
-				VoxIntToVert(chunkVerts[i*4+3]),
-			};
-
-			trimesh->addTriangle(vs[0], vs[1], vs[2]);
-			trimesh->addTriangle(vs[0], vs[2], vs[3]);
+void Chunk::GenerateCollider(ChunkMeshBuilder* meshBuilder) {
+	auto neigh = neighborhood.lock();
+	if(neigh) neigh->RemoveChunkCollider(this);
+	collider.reset();
+
+	// Nothing to collide with, or nothing to attach a collider to
+	if(IsEmpty() || !neigh) return;
+
+	// Identical chunks can share one shape, and skip meshing entirely
+	auto manager = ChunkManager::Instance();
+	collider = manager->colliderCache.Get(contentHash);
+
+	if(!collider) {
+		u32 numQuads = meshBuilder->BuildMesh(this);
+
+		// If a mesh was generated, generate a new collider
+		if(numQuads) {
+			auto trimesh = new btTriangleMesh();
+			u32* chunkVerts = (u32*)meshBuilder->vertexBuildBuffer;
+			for(u64 i = 0; i < numQuads; i++) {
+				btVector3 vs[] = {
+					VoxIntToVert(chunkVerts[i*4+0]),
+					VoxIntToVert(chunkVerts[i*4+1]),
+					VoxIntToVert(chunkVerts[i*4+2]),
+					VoxIntToVert(chunkVerts[i*4+3]),
+				};
+
+				trimesh->addTriangle(vs[0], vs[1], vs[2]);
+				trimesh->addTriangle(vs[0], vs[2], vs[3]);
+			}
+
+			collider = std::shared_ptr<Collider>(new btBvhTriangleMeshShape{trimesh, true}, [](Collider* c) {
+				auto tmsh = (btBvhTriangleMeshShape*) c;
+				delete tmsh->getMeshInterface();
+				delete tmsh;
+			});
+
+			manager->colliderCache.Add(contentHash, collider);
 		}
-
-		collider = new btBvhTriangleMeshShape{trimesh, true};
-		collider->setUserPointer(this);
-
-		rigidbody->setCollisionShape(collider);
-		Physics::world->addRigidBody(rigidbody);
 	}
+
+	if(collider)
+		neigh->SetChunkCollider(this, collider.get());
 }
 
 void Chunk::Update() {
-	// TODO: Check bordering voxels of neighbors and copy into margin
-	// Otherwise AO breaks
-	// Or rather notify neighbors when edges change
-	// OR do AO ourself
+	// TODO: Margins only reflect whole opaque faces of neighbors
+	// AO across partially filled chunk borders is still broken
 
 	// This could alternatively be done on a per block basis
 	//	rather than updating every voxel in the chunk
 	if(blocksDirty) {
 		UpdateVoxelData();
 		blocksDirty = false;
+		marginsDirty = false;
+
+	}else if(marginsDirty) {
+		if(UpdateMargins()) {
+			voxelVersion++;
+			physicsDirty = true;
+		}
+		marginsDirty = false;
 	}
 
 	if(physicsDirty) {
 		// TODO: NOT THIS
-		GenerateCollider(ChunkManager::Get()->meshBuilder);
+		GenerateCollider(ChunkManager::Instance()->meshBuilder.get());
 		physicsDirty = false;
 	}
-
-	// Update collider transform
-	btTransform worldTrans;
-	worldTrans.setFromOpenGLMatrix(glm::value_ptr(glm::translate(position) * glm::mat4_cast(rotation)));
-	rigidbody->setCenterOfMassTransform(worldTrans);
 }
 
 void Chunk::UpdateVoxelData() {
@@ -160,43 +190,199 @@ void Chunk::UpdateVoxelData() {
 		auto idx = 1 + z + (y+1)*(depth+2) + (x+1)*(depth+2)*(height+2);
 		auto block = &blocks[z + y*depth + x*depth*height];
 
-		if(!block->IsValid()) {
-			geometryData[idx] = 0;
-			occlusionData[idx] = 255;
-			continue;
+		u8 geometry = 0;
+		u8 rotation = 0;
+		u8 occlusion = 255;
+		u8 emission = 0;
+
+		if(block->IsValid()) {
+			auto bi = block->GetInfo();
+			occlusion = bi->doesOcclude? 0:255;
+			emission = bi->lightEmission;
+			rotation = block->orientation;
+
+			if(bi->RequiresIDsForRotations()) {
+				geometry = bi->voxelID + block->orientation;
+			}else{
+				geometry = bi->voxelID;
+			}
 		}
 
-		auto bi = block->GetInfo();
-		occlusionData[idx] = bi->doesOcclude? 0:255;
-		rotationData[idx] = block->orientation;
+		if(geometry == geometryData[idx]
+		&& rotation == rotationData[idx]
+		&& occlusion == occlusionData[idx]) continue;
 
-		if(bi->RequiresIDsForRotations()) {
-			geometryData[idx] = bi->voxelID + block->orientation;
-		}else{
-			geometryData[idx] = bi->voxelID;		
+		contentHash -= VoxelHashTerm(idx, geometryData[idx], rotationData[idx], occlusionData[idx]);
+		contentHash += VoxelHashTerm(idx, geometry, rotation, occlusion);
+
+		// Block type changed, so its opacity or emission may have.
+		//	The light engine ignores edits that change neither
+		if(lightField && geometry != geometryData[idx]) {
+			u32 cell = z + y*depth + x*depth*height;
+			lightField->stagedEdits.push_back(LightEdit{cell, occlusion == 0, emission});
+		}
+
+		geometryData[idx] = geometry;
+		rotationData[idx] = rotation;
+		occlusionData[idx] = occlusion;
+	}
+
+	UpdateMargins();
+	UpdateFaceConnectivity();
+
+	// Neighbors need to update their margins against faces that changed
+	u8 opaqueFaces = GetOpaqueFaces();
+	u8 changedFaces = opaqueFaces ^ lastOpaqueFaces;
+	lastOpaqueFaces = opaqueFaces;
+
+	auto neigh = neighborhood.lock();
+	if(changedFaces && neigh) {
+		for(u8 f = 0; f < ChunkFace::Count; f++) {
+			if(!(changedFaces & (1<<f))) continue;
+
+			if(auto n = neigh->GetChunkAt(positionInNeighborhood + ChunkFace::Direction(f)))
+				n->marginsDirty = true;
 		}
 	}
 
-	renderDirty = true;
+	voxelVersion++;
 	physicsDirty = true;
 }
 
+bool Chunk::UpdateMargins() {
+	auto neigh = neighborhood.lock();
+	u8 marginVoxelID = ChunkManager::Instance()->meshBuilder->marginVoxelID;
+	u8 dims[] {width, height, depth};
+	bool changed = false;
+
+	for(u8 f = 0; f < ChunkFace::Count; f++) {
+		u8 axis = f/2;
+		u8 ua = (axis+1)%3;
+		u8 va = (axis+2)%3;
+
+		bool opaque = false;
+		if(neigh) {
+			auto n = neigh->GetChunkAt(positionInNeighborhood + ChunkFace::Direction(f));
+			opaque = n && n->IsFaceOpaque(ChunkFace::Opposite(f));
+		}
+
+		u8 geometry = opaque? marginVoxelID : 0;
+		u8 occlusion = opaque? 0 : 255;
+
+		// Margin coordinates, so the layer past the last cell is dims+1
+		ivec3 p;
+		p[axis] = (f%2 == 0)? dims[axis]+1 : 0;
+
+		for(p[ua] = 1; p[ua] <= dims[ua]; p[ua]++)
+		for(p[va] = 1; p[va] <= dims[va]; p[va]++) {
+			auto idx = p.z + p.y*(depth+2) + p.x*(depth+2)*(height+2);
+			if(geometry == geometryData[idx] && occlusion == occlusionData[idx]) continue;
+
+			contentHash -= VoxelHashTerm(idx, geometryData[idx], rotationData[idx], occlusionData[idx]);
+			contentHash += VoxelHashTerm(idx, geometry, 0, occlusion);
+
+			geometryData[idx] = geometry;
+			rotationData[idx] = 0;
+			occlusionData[idx] = occlusion;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+void Chunk::UpdateFaceConnectivity() {
+	constexpr u8 allFaces = (1<<ChunkFace::Count)-1;
+	memset(faceConnectivity, 0, sizeof(faceConnectivity));
+
+	u32 numCells = width*height*depth;
+	std::vector<u8> visited(numCells, 0);
+	std::vector<u32> stack;
+
+	auto IsOpen = [this](u32 x, u32 y, u32 z) {
+		auto idx = 1 + z + (y+1)*(depth+2) + (x+1)*(depth+2)*(height+2);
+		return occlusionData[idx] == 255;
+	};
+
+	// Flood fill each open region and record which faces it touches.
+	// Every face touched by a region can see every other face it touches
+	for(u32 start = 0; start < numCells; start++) {
+		if(visited[start]) continue;
+		visited[start] = 1;
+
+		if(!IsOpen(start/(depth*height), (start/depth)%height, start%depth))
+			continue;
+
+		u8 touched = 0;
+		stack.push_back(start);
+
+		while(!stack.empty()) {
+			u32 i = stack.back();
+			stack.pop_back();
+
+			s32 x = i/(depth*height);
+			s32 y = (i/depth)%height;
+			s32 z = i%depth;
+
+			if(x == 0) touched |= 1<<ChunkFace::NegX;
+			if(y == 0) touched |= 1<<ChunkFace::NegY;
+			if(z == 0) touched |= 1<<ChunkFace::NegZ;
+			if(x == width-1) touched |= 1<<ChunkFace::PosX;
+			if(y == height-1) touched |= 1<<ChunkFace::PosY;
+			if(z == depth-1) touched |= 1<<ChunkFace::PosZ;
+
+			for(u8 f = 0; f < ChunkFace::Count; f++) {
+				auto n = ivec3{x,y,z} + ChunkFace::Direction(f);
+				if(!InBounds(n)) continue;
+
+				u32 ni = n.z + n.y*depth + n.x*depth*height;
+				if(visited[ni]) continue;
+				visited[ni] = 1;
+
+				if(IsOpen(n.x, n.y, n.z))
+					stack.push_back(ni);
+			}
+		}
+
+		for(u8 f = 0; f < ChunkFace::Count; f++) {
+			if(touched & (1<<f))
+				faceConnectivity[f] |= touched;
+		}
+
+		// Can't do any better than this
+		if(touched == allFaces) break;
+	}
+}
+
+void Chunk::SetLightData(const u8* light) {
+	u32 size = (width+2)*(height+2)*(depth+2);
+	bool changed = false;
+
+	for(u32 i = 0; i < size; i++) {
+		if(light[i] == lightData[i]) continue;
+
+		if(lightData[i]) lightHash -= LightHashTerm(i, lightData[i]);
+		if(light[i]) lightHash += LightHashTerm(i, light[i]);
+
+		lightData[i] = light[i];
+		changed = true;
+	}
+
+	if(changed) voxelVersion++;
+}
+
+bool Chunk::FacesConnected(u8 a, u8 b) {
+	return faceConnectivity[a] & (1<<b);
+}
+
 std::shared_ptr<Chunk> Chunk::GetOrCreateNeighborContaining(ivec3 vxpos) {
 	auto manager = ChunkManager::Get();
 	std::shared_ptr<ChunkNeighborhood> neigh;
 
 	if(neigh = neighborhood.lock()) {
-		vec3 world = VoxelToWorldSpace(vxpos);
+		if(auto ch = neigh->GetChunkContaining(VoxelToWorldSpace(vxpos)))
+			return ch;
 
-		// TODO: It might be a good idea to use positionInNeighborhood for this
-		// Low priority as this won't get called often
-		for(auto& n: neigh->chunks) {
-			auto ch = n.lock();
-			if(!ch) continue;
-
-			auto vxpos = ch->WorldToVoxelSpace(world);
-			if(ch->InBounds(vxpos)) return ch;
-		}
 	}else{
 		neigh = manager->CreateNeighborhood();
 		SetNeighborhood(neigh);
@@ -215,20 +401,22 @@ std::shared_ptr<Chunk> Chunk::GetOrCreateNeighborContaining(ivec3 vxpos) {
 	auto chunk = manager->CreateChunk(width, height, depth);
 
 	chunk->SetNeighborhood(neigh);
-	chunk->positionInNeighborhood = positionInNeighborhood + orthoDir;
-
-	neigh->UpdateChunkTransform(chunk);
+	neigh->SetChunkPosition(chunk.get(), positionInNeighborhood + orthoDir);
 
 	return chunk;
 }
 
 void Chunk::SetNeighborhood(std::shared_ptr<ChunkNeighborhood> n) {	
 	if(auto neigh = neighborhood.lock()) {
-		neigh->RemoveChunk(self.lock());
+		neigh->RemoveChunk(this);
+		if(neigh != n) ChunkManager::Instance()->DestroyNeighborhoodIfEmpty(neigh.get());
 	}
 
-	n->AddChunk(self.lock());
+	n->AddChunk(this);
 	neighborhood = n;
+
+	// Collider needs to move to the new neighborhood's body
+	physicsDirty = true;
 }
 
 Block* Chunk::CreateBlock(ivec3 pos, const std::string& name, u16 playerID) {
@@ -252,7 +440,8 @@ Block* Chunk::CreateBlock(ivec3 pos, u16 id, u16 playerID) {
 	// TODO: Is this good enough?
 	// If a block already exists destroy it
 	auto block = &blocks[idx];
-	if(block->IsValid()) {
+	u16 oldID = block->IsValid()? block->blockID : 0;
+	if(oldID) {
 		if(auto dyn = block->dynamic)
 			dyn->OnBreak(playerID);
 
@@ -264,7 +453,14 @@ Block* Chunk::CreateBlock(ivec3 pos, u16 id, u16 playerID) {
 	// Attempt to create block in place
 	//	and return nullptr on fail
 	factory->Create(block);
-	if(!block->IsValid()) return nullptr;
+	if(!block->IsValid()) {
+		TrackBlockChange(pos, oldID, 0);
+		blocksDirty = true;
+		blocksVersion++;
+		return nullptr;
+	}
+
+	TrackBlockChange(pos, oldID, block->blockID);
 
 	if(auto dyn = block->dynamic) {
 		dyn->x = pos.x;
@@ -276,6 +472,7 @@ Block* Chunk::CreateBlock(ivec3 pos, u16 id, u16 playerID) {
 	}
 
 	blocksDirty = true;
+	blocksVersion++;
 	return block;
 }
 
@@ -287,6 +484,8 @@ void Chunk::DestroyBlock(ivec3 pos, u16 playerID) {
 
 	// TODO: Some of this should probably be deferred
 	if(block->IsValid()) {
+		u16 oldID = block->blockID;
+
 		if(auto dyn = block->dynamic)
 			dyn->OnBreak(playerID);
 
@@ -300,8 +499,182 @@ void Chunk::DestroyBlock(ivec3 pos, u16 playerID) {
 			logger << "BlockName: " << (bi? bi->name : "<null blockinfo>");
 		}
 	
+		TrackBlockChange(pos, oldID, block->IsValid()? block->blockID : 0);
 		blocksDirty = true;
+		blocksVersion++;
+	}
+}
+
+// Edit generators. These are plain structs rather than lambdas so that the
+//	per cell callback is a template parameter instead of a std::function
+namespace {
+	struct RegionEdits {
+		ivec3 min, max;
+		u32 depth, height;
+		BlockInfo* info;
+		u8 orientation;
+
+		template<class F>
+		void operator()(const F& edit) const {
+			for(s32 x = min.x; x < max.x; x++)
+			for(s32 y = min.y; y < max.y; y++)
+			for(s32 z = min.z; z < max.z; z++)
+				edit(z + y*depth + x*depth*height, info, orientation);
+		}
+	};
+
+	struct SpanEdits {
+		u32 offset, count;
+		const u16* packedBlocks;
+
+		template<class F>
+		void operator()(const F& edit) const {
+			for(u32 i = 0; i < count; i++) {
+				u16 blockID = packedBlocks[i] >> 2;
+				auto bi = BlockRegistry::GetBlockInfo(blockID);
+				if(blockID && !bi) continue;
+
+				edit(offset + i, bi, packedBlocks[i] & 3);
+			}
+		}
+	};
+
+	struct ResolvedEdit {
+		u32 index;
+		BlockInfo* info;
+		u8 orientation;
+	};
+
+	// Cells must be unique
+	struct ResolvedEdits {
+		const std::vector<ResolvedEdit>& edits;
+
+		template<class F>
+		void operator()(const F& edit) const {
+			for(auto& e: edits)
+				edit(e.index, e.info, e.orientation);
+		}
+	};
+}
+
+// Applies a batch of edits produced by forEachEdit, which is called with a
+//	function taking (cell index, BlockInfo or nullptr for air, orientation).
+//	It's run twice, once to fire OnBreak and once to write storage.
+// NOTE: Generators must produce each cell at most once. The first pass reads
+//	storage before anything is written, and a dynamic block created then
+//	destroyed within the batch would still be in placed
+template<class EditGenerator>
+static void ApplyBulkEdits(Chunk* ch, EditGenerator forEachEdit, u16 playerID) {
+	u32 d = ch->depth;
+	u32 h = ch->height;
+
+	forEachEdit([ch, playerID](u32 idx, BlockInfo* bi, u8) {
+		auto block = &ch->blocks[idx];
+		if(!block->IsValid() || !block->dynamic) return;
+		if(bi && bi->blockID == block->blockID) return;
+
+		block->dynamic->OnBreak(playerID);
+	});
+
+	std::vector<DynamicBlock*> placed;
+	bool changed = false;
+
+	forEachEdit([&](u32 idx, BlockInfo* bi, u8 orientation) {
+		auto block = &ch->blocks[idx];
+		u16 oldID = block->IsValid()? block->blockID : 0;
+		u16 newID = bi? bi->blockID : 0;
+
+		if(oldID == newID) {
+			if(newID && block->orientation != orientation) {
+				block->orientation = orientation;
+				changed = true;
+			}
+			return;
+		}
+
+		if(oldID) {
+			if(auto factory = block->GetFactory())
+				factory->Destroy(block);
+		}
+
+		ivec3 pos {(s32)(idx/(d*h)), (s32)((idx/d)%h), (s32)(idx%d)};
+
+		if(bi) {
+			if(!bi->factory) throw "Block " + std::to_string(newID) + " missing factory";
+
+			bi->factory->Create(block);
+			block->orientation = orientation;
+
+			if(auto dyn = block->dynamic) {
+				dyn->x = pos.x;
+				dyn->y = pos.y;
+				dyn->z = pos.z;
+				dyn->chunk = ch;
+				placed.push_back(dyn);
+			}
+		}
+
+		ch->TrackBlockChange(pos, oldID, block->IsValid()? block->blockID : 0);
+		changed = true;
+	});
+
+	if(changed) {
+		ch->blocksDirty = true;
+		ch->blocksVersion++;
+	}
+
+	for(auto dyn: placed)
+		dyn->OnPlace(playerID);
+}
+
+void Chunk::FillRegion(ivec3 min, ivec3 max, const std::string& name, u8 orientation, u16 playerID) {
+	FillRegion(min, max, BlockRegistry::GetBlockIDByName(name), orientation, playerID);
+}
+
+void Chunk::FillRegion(ivec3 min, ivec3 max, u16 blockID, u8 orientation, u16 playerID) {
+	auto bi = BlockRegistry::GetBlockInfo(blockID);
+	if(blockID && !bi) return;
+
+	min = glm::max(min, ivec3{0});
+	max = glm::min(max, ivec3{width, height, depth});
+	if(min.x >= max.x || min.y >= max.y || min.z >= max.z) return;
+
+	ApplyBulkEdits(this, RegionEdits{min, max, depth, height, bi, orientation}, playerID);
+}
+
+void Chunk::SetSpan(u32 offset, u32 count, const u16* packedBlocks, u16 playerID) {
+	count = std::min(count, (u32)width*height*depth - std::min<u32>(offset, width*height*depth));
+
+	ApplyBulkEdits(this, SpanEdits{offset, count, packedBlocks}, playerID);
+}
+
+void Chunk::ApplyEdits(const std::vector<BlockEdit>& edits, u16 playerID) {
+	std::vector<ResolvedEdit> resolved;
+	resolved.reserve(edits.size());
+
+	for(auto& e: edits) {
+		if(!InBounds(e.position)) continue;
+
+		auto bi = BlockRegistry::GetBlockInfo(e.blockID);
+		if(e.blockID && !bi) continue;
+
+		u32 index = e.position.z + e.position.y*depth + e.position.x*depth*height;
+		resolved.push_back(ResolvedEdit{index, bi, e.orientation});
 	}
+
+	// Later edits to a cell win. Stable, so the last one of a run is the latest
+	std::stable_sort(resolved.begin(), resolved.end(), [](const ResolvedEdit& a, const ResolvedEdit& b) {
+		return a.index < b.index;
+	});
+
+	u32 count = 0;
+	for(u32 i = 0; i < resolved.size(); i++) {
+		if(i+1 < resolved.size() && resolved[i+1].index == resolved[i].index) continue;
+		resolved[count++] = resolved[i];
+	}
+	resolved.resize(count);
+
+	ApplyBulkEdits(this, ResolvedEdits{resolved}, playerID);
 }
 
 Block* Chunk::GetBlock(ivec3 pos) {
@@ -314,6 +687,81 @@ Block* Chunk::GetBlock(ivec3 pos) {
 	return block->IsValid() ? block : nullptr;
 }
 
+u64 Chunk::GetBlocksHash() {
+	if(blocksHashVersion == blocksVersion) return blocksHash;
+
+	u32 numBlocks = width*height*depth;
+	blocksHash = HashMix((u64)width << 16 | (u64)height << 8 | depth);
+
+	for(u32 i = 0; i < numBlocks; i++) {
+		auto& b = blocks[i];
+		if(!b.IsValid()) continue;
+
+		blocksHash += HashMix((u64)i << 16 | (u64)(b.blockID << 2 | b.orientation));
+	}
+
+	blocksHashVersion = blocksVersion;
+	return blocksHash;
+}
+
+void Chunk::TrackBlockChange(ivec3 pos, u16 oldID, u16 newID) {
+	if(oldID == newID) return;
+
+	if(oldID) {
+		blockCount--;
+		if(!--blockTypeCounts[oldID])
+			blockTypeCounts.erase(oldID);
+	}
+
+	if(newID) {
+		blockCount++;
+		blockTypeCounts[newID]++;
+	}
+
+	auto Occludes = [](u16 id) {
+		auto bi = BlockRegistry::GetBlockInfo(id);
+		return bi && bi->doesOcclude;
+	};
+
+	s32 delta = (s32)Occludes(newID) - (s32)Occludes(oldID);
+	if(!delta) return;
+
+	if(pos.x == width-1)	opaqueFaceCells[ChunkFace::PosX] += delta;
+	if(pos.x == 0)			opaqueFaceCells[ChunkFace::NegX] += delta;
+	if(pos.y == height-1)	opaqueFaceCells[ChunkFace::PosY] += delta;
+	if(pos.y == 0)			opaqueFaceCells[ChunkFace::NegY] += delta;
+	if(pos.z == depth-1)	opaqueFaceCells[ChunkFace::PosZ] += delta;
+	if(pos.z == 0)			opaqueFaceCells[ChunkFace::NegZ] += delta;
+}
+
+bool Chunk::IsUniform() const {
+	if(IsEmpty()) return true;
+	return IsFull() && blockTypeCounts.size() == 1;
+}
+
+u16 Chunk::GetUniformBlockID() const {
+	if(IsEmpty() || !IsUniform()) return 0;
+	return blockTypeCounts.begin()->first;
+}
+
+u32 Chunk::GetFaceArea(u8 f) const {
+	switch(f) {
+	case ChunkFace::PosX: case ChunkFace::NegX: return (u32)height*depth;
+	case ChunkFace::PosY: case ChunkFace::NegY: return (u32)width*depth;
+	default: return (u32)width*height;
+	}
+}
+
+u8 Chunk::GetOpaqueFaces() const {
+	u8 mask = 0;
+	for(u8 f = 0; f < ChunkFace::Count; f++) {
+		if(opaqueFaceCells[f] == GetFaceArea(f))
+			mask |= 1<<f;
+	}
+
+	return mask;
+}
+
 ivec3 Chunk::WorldToVoxelSpace(vec3 w) {
 	auto modelSpace = glm::inverse(rotation) * (w - position);
 	return ivec3 {
@@ -329,6 +777,16 @@ vec3 Chunk::VoxelToWorldSpace(ivec3 v) {
 	return position + modelSpace;
 }
 
+ivec3 ChunkFace::Direction(u8 f) {
+	static const ivec3 directions[] {
+		ivec3{ 1, 0, 0}, ivec3{-1, 0, 0},
+		ivec3{ 0, 1, 0}, ivec3{ 0,-1, 0},
+		ivec3{ 0, 0, 1}, ivec3{ 0, 0,-1},
+	};
+
+	return directions[f];
+}
+
 bool Chunk::InBounds(ivec3 p) {
 	return !(
 		(u32)p.x >= width || 
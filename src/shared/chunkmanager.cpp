@@ -1,10 +1,13 @@
 #include "chunkmeshbuilder.h"
 #include "chunkmanager.h"
+#include "blocklight.h"
 #include "chunk.h"
 #include "block.h"
 
 static Log logger{"ChunkManager"};
 
+static ChunkManager* instance = nullptr;
+
 std::shared_ptr<ChunkManager> ChunkManager::Get() {
 	static std::weak_ptr<ChunkManager> wp;
 	std::shared_ptr<ChunkManager> p;
@@ -15,24 +18,30 @@ std::shared_ptr<ChunkManager> ChunkManager::Get() {
 	return p;
 }
 
+ChunkManager* ChunkManager::Instance() {
+	return instance;
+}
+
 ChunkManager::ChunkManager() {
 	meshBuilder = std::make_shared<ChunkMeshBuilder>();
+	instance = this;
+}
+ChunkManager::~ChunkManager() {
+	instance = nullptr;
 }
-ChunkManager::~ChunkManager() {}
 
 std::shared_ptr<Chunk> ChunkManager::CreateChunk(u32 w, u32 h, u32 d) {
 	auto nchunk = std::make_shared<Chunk>(w,h,d);
-	chunks.push_back(nchunk);
+	nchunk->handle = chunks.Add(nchunk);
 
 	nchunk->chunkID = 0;
 	nchunk->position = vec3{0.f};
-	nchunk->self = nchunk;
 	return nchunk;
 }
 
 std::shared_ptr<ChunkNeighborhood> ChunkManager::CreateNeighborhood() {
 	auto nhood = std::make_shared<ChunkNeighborhood>();
-	neighborhoods.emplace_back(nhood);
+	nhood->handle = neighborhoods.Add(nhood);
 	return nhood;
 }
 
@@ -40,6 +49,17 @@ void ChunkManager::Update() {
 	for(auto& vc: chunks) {
 		vc->Update();
 	}
+
+	CollectDestroyedChunks();
+
+	if(lightEngine) lightEngine->Update(this);
+}
+
+void ChunkManager::UpdateNeighborhoodMotion(f32 dt) {
+	for(auto& neigh: neighborhoods) {
+		if(neigh->Extrapolate(dt))
+			neigh->UpdateChunkTransforms();
+	}
 }
 
 std::shared_ptr<Chunk> ChunkManager::GetChunk(u16 id) {
@@ -52,12 +72,24 @@ std::shared_ptr<Chunk> ChunkManager::GetChunk(u16 id) {
 }
 
 void ChunkManager::DestroyChunk(u16 id) {
-	auto it = std::find_if(chunks.begin(), chunks.end(), [id](const std::shared_ptr<Chunk>& ch) {
-		return id == ch->chunkID;
-	});
+	if(auto ch = GetChunk(id))
+		destroyedChunks.push_back(ch->handle);
+}
+
+void ChunkManager::CollectDestroyedChunks() {
+	for(auto h: destroyedChunks) {
+		auto ch = chunks.Get(h);
+		if(!ch) continue;
+
+		if(auto neigh = ch->neighborhood.lock()) {
+			neigh->RemoveChunk(ch);
+			DestroyNeighborhoodIfEmpty(neigh.get());
+		}
 
-	if(it == chunks.end()) return;
-	chunks.erase(it);
+		chunks.Remove(h);
+	}
+
+	destroyedChunks.clear();
 }
 
 std::shared_ptr<ChunkNeighborhood> ChunkManager::GetNeighborhood(u16 id) {
@@ -70,6 +102,13 @@ std::shared_ptr<ChunkNeighborhood> ChunkManager::GetNeighborhood(u16 id) {
 	return *it;
 }
 
+void ChunkManager::DestroyNeighborhoodIfEmpty(ChunkNeighborhood* neigh) {
+	if(!neigh->chunks.empty()) return;
+
+	// Its physics space and bodies go with it
+	neighborhoods.Remove(neigh->handle);
+}
+
 /*
 	                                                                                                                                       
 	888b      88            88             88          88                                 88                                           88  
@@ -83,34 +122,218 @@ std::shared_ptr<ChunkNeighborhood> ChunkManager::GetNeighborhood(u16 id) {
 	                            aa,    ,88                                                                                                 
 	                             "Y8bbdP"                                                                                                  
 */
-void ChunkNeighborhood::AddChunk(std::shared_ptr<Chunk> c) {
+ChunkNeighborhood::ChunkNeighborhood() 
+	: chunkSize{0}, neighborhoodID{0}, position{0.f}, rotation{1,0,0,0}, 
+	velocity{0.f}, angularVelocity{0.f}, pivot{0.f}, bodyInWorld{false}, space{nullptr}, spaceShape{nullptr}, localBody{nullptr} {
+
+	compoundShape = new btCompoundShape{};
+
+	RigidBodyInfo bodyInfo{0.f, nullptr, compoundShape, btVector3{0,0,0}};
+	rigidbody = new RigidBody{bodyInfo};
+
+	// Colliders are shared between chunks, so raycasts find chunks through the body
+	rigidbody->setUserPointer(this);
+}
+
+ChunkNeighborhood::~ChunkNeighborhood() {
+	if(bodyInWorld)
+		Physics::world->removeRigidBody(rigidbody);
+
+	for(auto ch: compoundChunks)
+		ch->compoundIndex = -1;
+
+	if(space) {
+		space->world->removeRigidBody(localBody);
+		Physics::DestroySpace(space);
+		delete localBody;
+		delete spaceShape;
+	}
+
+	delete rigidbody;
+	delete compoundShape;
+}
+
+void ChunkNeighborhood::AddChunk(Chunk* c) {
 	if(!chunks.size()) {
 		chunkSize = ivec3{c->width, c->height, c->depth};
 		c->positionInNeighborhood = ivec3{0};
 	}
 
-	chunks.emplace_back(c);
+	chunks.push_back(c->handle);
+
+	// A chunk coming from another neighborhood still has its old position,
+	//	which mustn't displace a chunk already there. It'll be moved after
+	chunkPositions.emplace(PositionKey(c->positionInNeighborhood), c->handle);
 }
 
-void ChunkNeighborhood::RemoveChunk(std::shared_ptr<Chunk> c) {
-	auto endIt = std::remove_if(chunks.begin(), chunks.end(), 
-		[&c](const std::weak_ptr<Chunk>& wn) {
-			return wn.lock() == c;
-	});
+void ChunkNeighborhood::RemoveChunk(Chunk* c) {
+	RemoveChunkCollider(c);
+	chunks.erase(std::remove(chunks.begin(), chunks.end(), c->handle), chunks.end());
+
+	auto it = chunkPositions.find(PositionKey(c->positionInNeighborhood));
+	if(it != chunkPositions.end() && it->second == c->handle)
+		chunkPositions.erase(it);
+}
+
+void ChunkNeighborhood::SetChunkPosition(Chunk* c, ivec3 pos) {
+	auto it = chunkPositions.find(PositionKey(c->positionInNeighborhood));
+	if(it != chunkPositions.end() && it->second == c->handle)
+		chunkPositions.erase(it);
 
-	chunks.erase(endIt, chunks.end());
+	c->positionInNeighborhood = pos;
+	chunkPositions[PositionKey(pos)] = c->handle;
+	UpdateChunkTransform(c);
+}
+
+u64 ChunkNeighborhood::PositionKey(ivec3 p) {
+	constexpr u64 mask = (1ull<<21)-1;
+	return ((u64)p.x & mask) << 42 | ((u64)p.y & mask) << 21 | ((u64)p.z & mask);
+}
+
+void ChunkNeighborhood::SetChunkCollider(Chunk* ch, Collider* collider) {
+	RemoveChunkCollider(ch);
+	if(!collider || !Physics::world) return;
+
+	auto offset = vec3{chunkSize * ch->positionInNeighborhood};
+	std::swap(offset.y, offset.z);
+	offset.z = -offset.z;
+
+	ch->compoundIndex = compoundChunks.size();
+	compoundChunks.push_back(ch);
+	btTransform childTrans{btQuaternion::getIdentity(), o2bt(offset)};
+	compoundShape->addChildShape(childTrans, collider);
+	if(spaceShape) spaceShape->addChildShape(childTrans, collider);
+
+	if(!bodyInWorld) {
+		btTransform worldTrans{o2bt(rotation), o2bt(position)};
+		rigidbody->setCenterOfMassTransform(worldTrans);
+		Physics::world->addRigidBody(rigidbody);
+		bodyInWorld = true;
+	}
+
+	UpdateSpace();
+}
+
+void ChunkNeighborhood::UpdateSpace() {
+	bool needsSpace = bodyInWorld && IsMoving();
+
+	if(needsSpace && !space) {
+		if(!Physics::world) return;
+
+		spaceShape = new btCompoundShape{};
+		for(s32 i = 0; i < compoundShape->getNumChildShapes(); i++)
+			spaceShape->addChildShape(compoundShape->getChildTransform(i), compoundShape->getChildShape(i));
+
+		space = Physics::CreateSpace(spaceShape);
+		space->position = position;
+		space->rotation = rotation;
+
+		RigidBodyInfo bodyInfo{0.f, nullptr, spaceShape, btVector3{0,0,0}};
+		localBody = new RigidBody{bodyInfo};
+		localBody->setUserPointer(this);
+		space->world->addRigidBody(localBody);
+
+	}else if(!needsSpace && space) {
+		space->world->removeRigidBody(localBody);
+		Physics::DestroySpace(space);
+		delete localBody;
+		delete spaceShape;
+		space = nullptr;
+		localBody = nullptr;
+		spaceShape = nullptr;
+	}
+}
+
+void ChunkNeighborhood::RemoveChunkCollider(Chunk* ch) {
+	if(ch->compoundIndex < 0) return;
+
+	// Compound shapes remove children by swapping the last one into their place
+	u32 idx = ch->compoundIndex;
+	compoundShape->removeChildShapeByIndex(idx);
+	if(spaceShape) spaceShape->removeChildShapeByIndex(idx);
+	compoundChunks[idx] = compoundChunks.back();
+	compoundChunks[idx]->compoundIndex = idx;
+	compoundChunks.pop_back();
+	ch->compoundIndex = -1;
+
+	if(compoundChunks.empty() && bodyInWorld) {
+		Physics::world->removeRigidBody(rigidbody);
+		bodyInWorld = false;
+		UpdateSpace();
+	}
+}
+
+Chunk* ChunkNeighborhood::GetChunkAt(ivec3 pos) {
+	auto it = chunkPositions.find(PositionKey(pos));
+	if(it == chunkPositions.end()) return nullptr;
+
+	auto ch = ChunkManager::Instance()->chunks.Get(it->second);
+	if(!ch || ch->positionInNeighborhood != pos) return nullptr;
+	return ch;
+}
+
+std::shared_ptr<Chunk> ChunkNeighborhood::GetChunkContaining(vec3 world) {
+	if(chunkSize == ivec3{0}) return nullptr;
+
+	// Voxel space of the chunk at positionInNeighborhood 0, as in Chunk::WorldToVoxelSpace
+	auto modelSpace = glm::inverse(rotation) * (world - position);
+	vec3 vx {
+		floor(modelSpace.x-1.f),
+		floor(-modelSpace.z-1.f),
+		floor(modelSpace.y-1.f),
+	};
+
+	auto ch = GetChunkAt(ivec3{glm::floor(vx / vec3{chunkSize})});
+	return ch? ChunkManager::Instance()->chunks.GetShared(ch->handle) : nullptr;
+}
+
+bool ChunkNeighborhood::IsMoving() const {
+	return velocity != vec3{0.f} || angularVelocity != vec3{0.f};
+}
+
+bool ChunkNeighborhood::Extrapolate(f32 dt) {
+	if(!IsMoving()) return false;
+
+	ExtrapolatePose(position, rotation, pivot, velocity, angularVelocity, dt);
+	return true;
+}
+
+void ChunkNeighborhood::ExtrapolatePose(vec3& position, quat& rotation, vec3 pivot,
+	vec3 velocity, vec3 angularVelocity, f32 dt) {
+
+	// Integrate about the pivot so that spinning neighborhoods
+	//	don't need a changing linear velocity
+	auto worldPivot = position + rotation * pivot + velocity * dt;
+
+	f32 angle = glm::length(angularVelocity) * dt;
+	if(angle > 0.f) {
+		auto axis = glm::normalize(angularVelocity);
+		rotation = glm::normalize(glm::angleAxis(angle, axis) * rotation);
+	}
+
+	position = worldPivot - rotation * pivot;
 }
 
 void ChunkNeighborhood::UpdateChunkTransforms() {
-	for(auto& wch: chunks) {
-		auto ch = wch.lock();
-		if(!ch) continue;
+	auto& registry = ChunkManager::Instance()->chunks;
+	for(auto h: chunks) {
+		if(auto ch = registry.Get(h))
+			UpdateChunkTransform(ch);
+	}
+
+	// Child shapes are in neighborhood space, so they don't need touching
+	btTransform worldTrans{o2bt(rotation), o2bt(position)};
+	rigidbody->setCenterOfMassTransform(worldTrans);
 
-		UpdateChunkTransform(ch);
+	// Bodies aboard move with the neighborhood for free
+	UpdateSpace();
+	if(space) {
+		space->position = position;
+		space->rotation = rotation;
 	}
 }
 
-void ChunkNeighborhood::UpdateChunkTransform(std::shared_ptr<Chunk> ch) {
+void ChunkNeighborhood::UpdateChunkTransform(Chunk* ch) {
 	auto offset = vec3{chunkSize * ch->positionInNeighborhood};
 	std::swap(offset.y, offset.z);
 	offset.z = -offset.z;
@@ -1,4 +1,5 @@
 #include "chunkmeshbuilder.h"
+#include "blocklight.h"
 #include "block.h"
 #include "chunk.h"
 
@@ -47,18 +48,100 @@ void ChunkMeshBuilder::PopulateVoxelInfo() {
 
 		logger << "Voxel type created for " << bt.name << ": " << bt.blockID << " -> " << bt.voxelID;
 	}
+
+	// Written into chunk margins against opaque neighbors. Only ever used for face culling
+	marginVoxelID = id;
+	voxelGeometryMap.push_back(STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_solid, 0, 0));
 }
 
-u32 ChunkMeshBuilder::BuildMesh(std::shared_ptr<Chunk> ch) {
-	auto vinput = stbvox_get_input_description(&mm);
-	vinput->blocktype = ch->geometryData;
-	vinput->lighting = ch->occlusionData; // NOTE: This can/should be omitted on the serverside
-	vinput->rotate = ch->rotationData;
+// Halves the resolution of a voxel grid. Each output voxel takes the most 
+//	common geometry of the 2x2x2 cells it covers, or is empty if fewer 
+//	than half of those cells are filled. Ties go to filled so that single
+//	voxel thick floors and walls survive every level
+static void DownsampleVoxels(const u8* geometry, const u8* rotation, const u8* lighting, 
+	u32 w, u32 h, u32 d, ChunkMeshBuilder::LodGrid& out) {
+
+	u32 lw = out.width = (w+1)/2;
+	u32 lh = out.height = (h+1)/2;
+	u32 ld = out.depth = (d+1)/2;
+
+	u32 size = (lw+2)*(lh+2)*(ld+2);
+	out.geometry.assign(size, 0);
+	out.rotation.assign(size, 0);
+	out.lighting.assign(size, 255);
+
+	for(u32 lx = 0; lx < lw; lx++)
+	for(u32 ly = 0; ly < lh; ly++)
+	for(u32 lz = 0; lz < ld; lz++) {
+		u32 cells[8];
+		u32 numCells = 0;
+
+		for(u32 x = lx*2; x < std::min(lx*2+2, w); x++)
+		for(u32 y = ly*2; y < std::min(ly*2+2, h); y++)
+		for(u32 z = lz*2; z < std::min(lz*2+2, d); z++)
+			cells[numCells++] = 1 + z + (y+1)*(d+2) + (x+1)*(d+2)*(h+2);
+
+		u32 numSolid = 0;
+		u32 best = 0, bestVotes = 0;
+		for(u32 i = 0; i < numCells; i++) {
+			if(!geometry[cells[i]]) continue;
+			numSolid++;
+
+			u32 votes = 0;
+			for(u32 j = 0; j < numCells; j++)
+				votes += geometry[cells[j]] == geometry[cells[i]];
+
+			if(votes > bestVotes) {
+				best = cells[i];
+				bestVotes = votes;
+			}
+		}
+
+		if(numSolid*2 < numCells) continue;
+
+		auto idx = 1 + lz + (ly+1)*(ld+2) + (lx+1)*(ld+2)*(lh+2);
+		out.geometry[idx] = geometry[best];
+		out.rotation[idx] = rotation[best];
+		out.lighting[idx] = lighting[best];
+	}
+}
+
+u32 ChunkMeshBuilder::BuildMesh(Chunk* ch, u8 lod) {
+	if(ch->IsEmpty()) return 0;
 
 	u32 w = ch->width;
 	u32 h = ch->height;
 	u32 d = ch->depth;
 
+	// NOTE: This can/should be omitted on the serverside
+	constexpr u32 lightRange = 255 - AmbientLighting;
+	lighting.resize((w+2)*(h+2)*(d+2));
+	for(u32 i = 0; i < lighting.size(); i++) {
+		if(!ch->occlusionData[i]) lighting[i] = 0;
+		else lighting[i] = AmbientLighting + ch->lightData[i]*lightRange/BlockLightEngine::MaxLightLevel;
+	}
+
+	auto vinput = stbvox_get_input_description(&mm);
+	vinput->blocktype = ch->geometryData;
+	vinput->lighting = &lighting[0];
+	vinput->rotate = ch->rotationData;
+
+	// Each level is built from the one before it rather than from the 
+	//	chunk, so thin features are preserved all the way down
+	lod = std::min<u8>(lod, LodCount-1);
+	for(u8 l = 0; l < lod; l++) {
+		auto& grid = lodGrids[l];
+		DownsampleVoxels(vinput->blocktype, vinput->rotate, vinput->lighting, w, h, d, grid);
+
+		vinput->blocktype = &grid.geometry[0];
+		vinput->rotate = &grid.rotation[0];
+		vinput->lighting = &grid.lighting[0];
+
+		w = grid.width;
+		h = grid.height;
+		d = grid.depth;
+	}
+
 	stbvox_set_input_stride(&mm, (d+2)*(h+2), (d+2));
 	stbvox_set_input_range(&mm, 1, 1, 1, w+1, h+1, d+1);
 	stbvox_set_default_mesh(&mm, 0);
@@ -3,6 +3,8 @@
 #include <raknet/RakPeerInterface.h>
 #include <raknet/MessageIdentifiers.h>
 
+#include <algorithm>
+
 static Log logger{"Network"};
 
 std::shared_ptr<Network> Network::Get() {
@@ -19,6 +21,7 @@ void Network::Init() {
 	peer = RakNet::RakPeerInterface::GetInstance();
 	isConnected = false;
 	isHosting = false;
+	coalesce = false;
 }
 
 void Network::Shutdown() {
@@ -51,7 +54,18 @@ void Network::Update() {
 		// TODO: This could be a bit more sophisticated
 		switch(type) {
 			case ID_CONNECTION_REQUEST_ACCEPTED: isConnected = true; break;
-			case ID_CONNECTION_LOST: isConnected = !isHosting; break;
+			case ID_NEW_INCOMING_CONNECTION: connections.push_back(packet->guid); break;
+
+			case ID_CONNECTION_LOST: 
+				isConnected = !isHosting;
+				// Fallthrough
+			case ID_DISCONNECTION_NOTIFICATION:
+				connections.erase(std::remove(connections.begin(), connections.end(), packet->guid), connections.end());
+				break;
+
+			case PacketType::Batch:
+				Unbatch(packet->data, packet->length, packet->guid);
+				continue;
 		}
 
 		packets.emplace(packet->data, packet->length, packet->guid);
@@ -61,14 +75,127 @@ void Network::Update() {
 void Network::Send(const Packet& p, NetworkGUID to) {
 	if(!isConnected && !isHosting) throw "Tried to send while not connected";
 
+	if(coalesce) {
+		if(to == RakNet::UNASSIGNED_RAKNET_GUID) Broadcast(p);
+		else Queue(p, to);
+		return;
+	}
+
 	bool broadcast = (to == RakNet::UNASSIGNED_RAKNET_GUID);
-	peer->Send(&p.bitstream, p.priority, p.reliability, 0, to, broadcast);
+	peer->Send(&p.bitstream, p.priority, p.reliability, p.channel, to, broadcast);
 }
 
 void Network::Broadcast(const Packet& p, NetworkGUID excl) {
 	if(!isHosting) throw "Can't broadcast while not hosting";
 
-	peer->Send(&p.bitstream, p.priority, p.reliability, 0, excl, true);
+	if(coalesce) {
+		for(auto& guid: connections) {
+			if(guid != excl) Queue(p, guid);
+		}
+		return;
+	}
+
+	peer->Send(&p.bitstream, p.priority, p.reliability, p.channel, excl, true);
+}
+
+void Network::Queue(const Packet& p, NetworkGUID to) {
+	u32 size = p.bitstream.GetNumberOfBytesUsed();
+
+	// Only the newest batch of a channel can be appended to,
+	//	otherwise messages could overtake each other
+	Batch* batch = nullptr;
+	auto key = std::make_pair(to, p.channel);
+	auto it = newestBatches.find(key);
+	if(it != newestBatches.end()) batch = batches[it->second].get();
+
+	if(!batch || batch->priority != p.priority || batch->reliability != p.reliability
+	|| batch->payload.GetNumberOfBytesUsed() + sizeof(u32) + size > BatchSize) {
+		batch = new Batch;
+		batch->to = to;
+		batch->priority = p.priority;
+		batch->reliability = p.reliability;
+		batch->channel = p.channel;
+		batch->count = 0;
+
+		newestBatches[key] = batches.size();
+		batches.emplace_back(batch);
+	}
+
+	batch->payload.Write<u32>(size);
+	batch->payload.WriteAlignedBytes(p.bitstream.GetData(), size);
+	batch->count++;
+}
+
+void Network::Flush() {
+	Packet packet;
+
+	for(auto& batch: batches) {
+		// Lone messages go as they are
+		if(batch->count == 1) {
+			peer->Send((const char*)batch->payload.GetData() + sizeof(u32), batch->payload.GetNumberOfBytesUsed() - sizeof(u32),
+				batch->priority, batch->reliability, batch->channel, batch->to, false);
+			continue;
+		}
+
+		packet.Reset();
+		packet.WriteType(PacketType::Batch);
+		packet.Write<u16>(batch->count);
+		packet.bitstream.WriteAlignedBytes(batch->payload.GetData(), batch->payload.GetNumberOfBytesUsed());
+
+		peer->Send(&packet.bitstream, batch->priority, batch->reliability, batch->channel, batch->to, false);
+	}
+
+	batches.clear();
+	newestBatches.clear();
+}
+
+void Network::Unbatch(u8* data, u32 length, NetworkGUID from) {
+	RakNet::BitStream bs{data, length, false};
+	bs.IgnoreBytes(1);
+
+	u16 count = 0;
+	bs.Read(count);
+
+	for(u16 i = 0; i < count; i++) {
+		u32 size = 0;
+		bs.Read(size);
+		bs.AlignReadToByteBoundary();
+
+		u32 offset = (bs.GetReadOffset() + 7) / 8;
+		if(offset + size > length) {
+			logger << "Discarding malformed batch";
+			return;
+		}
+
+		packets.emplace(data + offset, size, from);
+		bs.IgnoreBytes(size);
+	}
+}
+
+u8 NetChannel::ForType(u8 type) {
+	switch(type) {
+	case PacketType::UpdatePlayerState:
+	case PacketType::SetPlayerName:
+	case PacketType::SetPlayerTeam:
+	case PacketType::SetPlayerSector:
+		return Players;
+
+	case PacketType::SetNeighborhoodTransform:
+		return Neighborhoods;
+
+	case PacketType::SetBlock:
+	case PacketType::SetBlockAck:
+	case PacketType::NewChunk:
+	case PacketType::RemoveChunk:
+	case PacketType::SetChunkNeighborhood:
+	case PacketType::ChunkDownload:
+	case PacketType::PlayerInteract:
+	case PacketType::RegionEdit:
+		return Chunks;
+
+	default:
+		return Session;
+	}
 }
 
 bool Network::GetPacket(Packet* p) {
@@ -99,13 +226,17 @@ bool Network::GetPacket(Packet* p) {
 using RakNet::RakNetGUID;
 
 Packet::Packet() {}
-Packet::Packet(Packet&& o) : guid{o.guid} { bitstream.Write(o.bitstream); }
+Packet::Packet(Packet&& o) : guid{o.guid}, priority{o.priority},
+	reliability{o.reliability}, channel{o.channel} { bitstream.Write(o.bitstream); }
 Packet::Packet(u8* data, u32 len, RakNetGUID from) : bitstream{data, len, true}, guid{from} {}
 
 Packet& Packet::operator= (Packet&& o) {
 	bitstream.Reset();
 	bitstream.Write(o.bitstream);
 	guid = o.guid;
+	priority = o.priority;
+	reliability = o.reliability;
+	channel = o.channel;
 	return *this;
 }
 
@@ -115,6 +246,7 @@ void Packet::Reset() {
 
 void Packet::WriteType(u8 id) {
 	bitstream.Write((RakNet::MessageID)id);
+	channel = NetChannel::ForType(id);
 }
 
 void Packet::Write(quat q) {
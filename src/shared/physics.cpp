@@ -4,29 +4,160 @@ World* Physics::world = nullptr;
 Solver* Physics::solver = nullptr;
 Broadphase* Physics::broadphase = nullptr;
 Dispatcher* Physics::dispatcher = nullptr;
+btCollisionConfiguration* Physics::collisionConfig = nullptr;
+vec3 Physics::gravity {0, -30., 0};
+
+PhysicsSpace Physics::globalSpace;
+std::vector<PhysicsSpace*> Physics::spaces;
+std::map<RigidBody*, PhysicsSpace*> Physics::bodySpaces;
 
 void Physics::Init() {
-	auto collisionConfig = new btDefaultCollisionConfiguration{};
+	collisionConfig = new btDefaultCollisionConfiguration{};
 	broadphase = new Broadphase{};
 	dispatcher = new Dispatcher{collisionConfig};
 	solver = new Solver{};
 
 	world = new World{dispatcher, broadphase, solver, collisionConfig};
-	world->setGravity({0, -30., 0});
+	world->setGravity(o2bt(gravity));
+
+	globalSpace.world = world;
+	globalSpace.collisionConfig = collisionConfig;
+	globalSpace.bounds = nullptr;
 }
 
-auto Physics::Raycast(vec3 _begin, vec3 _end) -> RaycastResult {
-	auto beg = o2bt(_begin);
-	auto end = o2bt(_end);
+void Physics::Step(f32 dt) {
+	world->stepSimulation((btScalar)dt, 10);
 
-	btCollisionWorld::ClosestRayResultCallback rayCallback{beg, end};
-	Physics::world->rayTest(beg, end, rayCallback);
+	// NOTE: Spaces are treated as inertial frames. Bodies aboard an
+	//	accelerating ship won't feel it
+	for(auto space: spaces) {
+		space->world->setGravity(o2bt(space->ToLocalDir(gravity)));
+		space->world->stepSimulation((btScalar)dt, 10);
+	}
+}
 
+auto Physics::Raycast(vec3 _begin, vec3 _end) -> RaycastResult {
 	RaycastResult res;
-	res.hit = rayCallback.hasHit();
-	res.position = bt2o(rayCallback.m_hitPointWorld);
-	res.normal = bt2o(rayCallback.m_hitNormalWorld);
-	res.rigidbody = (RigidBody*) rayCallback.m_collisionObject;
+	res.hit = false;
+	res.rigidbody = nullptr;
+	btScalar closest = 2.0;
+
+	auto test = [&](PhysicsSpace* space) {
+		auto beg = o2bt(space->ToLocal(_begin));
+		auto end = o2bt(space->ToLocal(_end));
+
+		btCollisionWorld::ClosestRayResultCallback rayCallback{beg, end};
+		space->world->rayTest(beg, end, rayCallback);
+		if(!rayCallback.hasHit() || rayCallback.m_closestHitFraction >= closest) return;
+
+		closest = rayCallback.m_closestHitFraction;
+		res.hit = true;
+		res.position = space->ToWorld(bt2o(rayCallback.m_hitPointWorld));
+		res.normal = space->ToWorldDir(bt2o(rayCallback.m_hitNormalWorld));
+		res.rigidbody = (RigidBody*) rayCallback.m_collisionObject;
+	};
+
+	test(&globalSpace);
+	for(auto space: spaces) test(space);
+
 	return res;
 }
 
+PhysicsSpace* Physics::CreateSpace(btCollisionShape* bounds) {
+	if(!world) return nullptr;
+
+	auto space = new PhysicsSpace;
+	space->collisionConfig = new btDefaultCollisionConfiguration{};
+	space->world = new World{new Dispatcher{space->collisionConfig},
+		new Broadphase{}, new Solver{}, space->collisionConfig};
+	space->bounds = bounds;
+
+	spaces.push_back(space);
+	return space;
+}
+
+void Physics::DestroySpace(PhysicsSpace* space) {
+	if(!space) return;
+
+	spaces.erase(std::remove(spaces.begin(), spaces.end(), space), spaces.end());
+
+	// Anything still aboard falls back into the global world
+	for(auto it = bodySpaces.begin(); it != bodySpaces.end();) {
+		auto body = (it++)->first;
+		if(GetBodySpace(body) == space)
+			MoveBody(body, &globalSpace);
+	}
+
+	auto w = space->world;
+	auto wsolver = w->getConstraintSolver();
+	auto wbroadphase = w->getBroadphase();
+	auto wdispatcher = w->getDispatcher();
+
+	delete w;
+	delete wsolver;
+	delete wbroadphase;
+	delete wdispatcher;
+	delete space->collisionConfig;
+	delete space;
+}
+
+PhysicsSpace* Physics::GetBodySpace(RigidBody* body) {
+	auto it = bodySpaces.find(body);
+	return (it == bodySpaces.end())? &globalSpace : it->second;
+}
+
+PhysicsSpace* Physics::UpdateBodySpace(RigidBody* body) {
+	auto current = GetBodySpace(body);
+	auto pos = current->ToWorld(bt2o(body->getWorldTransform().getOrigin()));
+
+	if(current != &globalSpace && current->Contains(pos, LeaveSpaceMargin))
+		return current;
+
+	PhysicsSpace* target = &globalSpace;
+	for(auto space: spaces) {
+		if(space != current && space->Contains(pos, EnterSpaceMargin)) {
+			target = space;
+			break;
+		}
+	}
+
+	MoveBody(body, target);
+	return target;
+}
+
+void Physics::MoveBody(RigidBody* body, PhysicsSpace* to) {
+	auto from = GetBodySpace(body);
+	if(from == to) return;
+
+	auto trans = body->getWorldTransform();
+	auto pos = from->ToWorld(bt2o(trans.getOrigin()));
+	auto rot = from->rotation * bt2o(trans.getRotation());
+	auto linVel = from->ToWorldDir(bt2o(body->getLinearVelocity()));
+	auto angVel = from->ToWorldDir(bt2o(body->getAngularVelocity()));
+
+	from->world->removeRigidBody(body);
+
+	trans.setOrigin(o2bt(to->ToLocal(pos)));
+	trans.setRotation(o2bt(glm::inverse(to->rotation) * rot));
+	body->setWorldTransform(trans);
+	body->setInterpolationWorldTransform(trans);
+	body->setLinearVelocity(o2bt(to->ToLocalDir(linVel)));
+	body->setAngularVelocity(o2bt(to->ToLocalDir(angVel)));
+
+	if(to == &globalSpace) bodySpaces.erase(body);
+	else bodySpaces[body] = to;
+
+	to->world->addRigidBody(body);
+}
+
+bool PhysicsSpace::Contains(vec3 w, f32 margin) const {
+	if(!bounds) return false;
+
+	btVector3 min, max;
+	bounds->getAabb(btTransform::getIdentity(), min, max);
+
+	auto p = ToLocal(w);
+	return p.x >= min.x()-margin && p.x <= max.x()+margin
+		&& p.y >= min.y()-margin && p.y <= max.y()+margin
+		&& p.z >= min.z()-margin && p.z <= max.z()+margin;
+}
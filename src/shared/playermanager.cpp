@@ -14,26 +14,26 @@ std::shared_ptr<PlayerManager> PlayerManager::Get() {
 
 void PlayerManager::AddPlayer(std::shared_ptr<PlayerBase> p, u16 id) {
 	p->playerID = id;
-	players.push_back(p);
+	p->handle = players.Add(p);
+	playerIDs[id] = p->handle;
 }
 
 void PlayerManager::RemovePlayer(u16 id) {
-	auto p = std::find_if(players.begin(), players.end(), 
-		[id](const std::shared_ptr<PlayerBase>& p) {
-			return id == p->playerID;
-	});
+	auto it = playerIDs.find(id);
+	if(it == playerIDs.end()) return;
 
-	players.erase(p);
+	players.Remove(it->second);
+	playerIDs.erase(it);
 }
 
 std::shared_ptr<PlayerBase> PlayerManager::GetPlayer(u16 id) {
-	auto p = std::find_if(players.begin(), players.end(), 
-		[id](const std::shared_ptr<PlayerBase>& p) {
-			return id == p->playerID;
-	});
+	auto it = playerIDs.find(id);
+	if(it == playerIDs.end()) return nullptr;
+	return players.GetShared(it->second);
+}
 
-	if(p == players.end()) return nullptr;
-	return *p;
+PlayerBase* PlayerManager::GetPlayer(Handle<PlayerBase> h) {
+	return players.Get(h);
 }
 
 void PlayerManager::Update() {
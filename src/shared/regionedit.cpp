@@ -0,0 +1,105 @@
+#include "regionedit.h"
+#include "block.h"
+#include "chunk.h"
+
+void BlockTemplate::Resize(ivec3 s) {
+	size = s;
+	blocks.assign(size.x*size.y*size.z, 0);
+}
+
+RegionEdit RegionEdit::Offset(ivec3 o) const {
+	RegionEdit e = *this;
+	e.min += o;
+	e.max += o;
+	return e;
+}
+
+u64 RegionEdit::Volume() const {
+	auto size = glm::max(max - min, ivec3{0});
+	return (u64)size.x * size.y * size.z;
+}
+
+bool ClipRegion(Chunk* ch, ivec3 min, ivec3 max, ivec3& cmin, ivec3& cmax) {
+	cmin = glm::max(min, ivec3{0});
+	cmax = glm::min(max, ivec3{ch->width, ch->height, ch->depth});
+	return cmin.x < cmax.x && cmin.y < cmax.y && cmin.z < cmax.z;
+}
+
+bool ApplyRegionEdit(Chunk* ch, const RegionEdit& e, const BlockTemplate* tmpl, u16 playerID) {
+	if(e.op == RegionOp::Paste && (!tmpl || tmpl->IsEmpty())) return false;
+
+	ivec3 max = (e.op == RegionOp::Paste)? e.min + tmpl->size : e.max;
+	ivec3 cmin, cmax;
+	if(!ClipRegion(ch, e.min, max, cmin, cmax)) return false;
+
+	u16 blockID = e.packedBlock >> 2;
+	u8 orientation = e.packedBlock & 3;
+
+	switch(e.op) {
+	case RegionOp::Fill:
+		ch->FillRegion(cmin, cmax, blockID, orientation, playerID);
+		break;
+
+	case RegionOp::Hollow:
+		// Clear the inside, then fill a slab for each face.
+		//	Edges are filled more than once, but refilling a cell
+		//	with the same type only touches its orientation
+		ch->FillRegion(glm::max(cmin, e.min+1), glm::min(cmax, e.max-1), 0, 0, playerID);
+
+		for(u32 axis = 0; axis < 3; axis++) {
+			for(s32 side: {e.min[axis], e.max[axis]-1}) {
+				ivec3 smin = cmin, smax = cmax;
+				smin[axis] = std::max(side, cmin[axis]);
+				smax[axis] = std::min(side+1, cmax[axis]);
+				ch->FillRegion(smin, smax, blockID, orientation, playerID);
+			}
+		}
+		break;
+
+	case RegionOp::Replace: {
+		std::vector<Chunk::BlockEdit> edits;
+		for(s32 x = cmin.x; x < cmax.x; x++)
+		for(s32 y = cmin.y; y < cmax.y; y++)
+		for(s32 z = cmin.z; z < cmax.z; z++) {
+			auto blk = ch->GetBlock(ivec3{x,y,z});
+			if((blk? blk->blockID : 0) != e.replaceID) continue;
+
+			edits.push_back(Chunk::BlockEdit{ivec3{x,y,z}, blockID, orientation});
+		}
+
+		ch->ApplyEdits(edits, playerID);
+	} break;
+
+	case RegionOp::Paste: {
+		std::vector<Chunk::BlockEdit> edits;
+		edits.reserve((cmax.x-cmin.x)*(cmax.y-cmin.y)*(cmax.z-cmin.z));
+
+		for(s32 x = cmin.x; x < cmax.x; x++)
+		for(s32 y = cmin.y; y < cmax.y; y++)
+		for(s32 z = cmin.z; z < cmax.z; z++) {
+			ivec3 pos {x,y,z};
+			u16 packed = tmpl->blocks[tmpl->Index(pos - e.min)];
+			edits.push_back(Chunk::BlockEdit{pos, (u16)(packed >> 2), (u8)(packed & 3)});
+		}
+
+		ch->ApplyEdits(edits, playerID);
+	} break;
+
+	default: return false;
+	}
+
+	return true;
+}
+
+void CopyRegion(Chunk* ch, ivec3 min, ivec3 max, BlockTemplate& tmpl) {
+	ivec3 cmin, cmax;
+	if(!ClipRegion(ch, min, max, cmin, cmax)) return;
+
+	for(s32 x = cmin.x; x < cmax.x; x++)
+	for(s32 y = cmin.y; y < cmax.y; y++)
+	for(s32 z = cmin.z; z < cmax.z; z++) {
+		ivec3 pos {x,y,z};
+		auto blk = ch->GetBlock(pos);
+		tmpl.blocks[tmpl.Index(pos - min)] = blk? (blk->blockID << 2 | blk->orientation) : 0;
+	}
+}